@@ -5,17 +5,25 @@ mkdir -p bin
 
 SRC_FILES="
     src/udp_common.c
+    src/clock_sync.c
     src/udp_sender.c
     src/udp_receiver.c
+    src/frame_ring.c
+    src/latency_histogram.c
+    src/frame_trace.c
+    src/bench.c
     src/video_capturer.c
     src/frame_pipe.c
     src/frame_recorder.c
+    src/frame_player.c
+    src/test_source.c
+    src/jpeg_decoder.c
     src/display_renderer.c
     src/mjpgo.c
 "
 
 CFLAGS="-Wall -Wextra -O2 -Iinclude"
-LDFLAGS="-lm -lturbojpeg -lavformat -lavcodec -lavutil -lSDL2"
+LDFLAGS="-pthread -lm -lturbojpeg -lavformat -lavcodec -lavutil -lSDL2"
 
 echo "Building mjpgo..."
 gcc $CFLAGS $SRC_FILES -o bin/mjpgo $LDFLAGS
@@ -0,0 +1,6 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+int bench_run(int argc, char** argv, int arg_start);
+
+#endif
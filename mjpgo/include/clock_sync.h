@@ -0,0 +1,37 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLOCK_SYNC_WINDOW 8
+#define CLOCK_SYNC_DRIFT_MIN_US 5000000
+#define CLOCK_SYNC_DRIFT_MAX 0.0005
+
+typedef struct {
+    int64_t offset_us;
+    uint64_t delay_us;
+    uint64_t at_us;
+} clock_sample_t;
+
+typedef struct {
+    clock_sample_t window[CLOCK_SYNC_WINDOW];
+    uint32_t window_count;
+    uint32_t window_next;
+    clock_sample_t anchor;
+    int64_t offset_us;
+    uint64_t ref_us;
+    uint64_t delay_us;
+    double drift;
+    bool drift_valid;
+    bool valid;
+    uint64_t samples;
+} clock_sync_t;
+
+void clock_sync_reset(clock_sync_t* cs);
+
+bool clock_sync_add_sample(clock_sync_t* cs, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+int64_t clock_sync_offset_at(const clock_sync_t* cs, uint64_t local_us);
+
+#endif
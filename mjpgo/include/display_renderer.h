@@ -1,19 +1,44 @@
 #ifndef DISPLAY_RENDERER_H
 #define DISPLAY_RENDERER_H
 
+#include "jpeg_decoder.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
+#define DISPLAY_RENDERER_RESET_US 1000000
+
 typedef struct display_renderer display_renderer_t;
 
+typedef struct {
+    uint64_t frames;
+    uint64_t decode_us;
+    uint64_t uploads;
+    uint64_t upload_us;
+} display_path_stats_t;
+
+typedef struct {
+    display_path_stats_t yuv;
+    display_path_stats_t rgb;
+    uint64_t displayed;
+    uint64_t skipped;
+} display_renderer_stats_t;
+
 display_renderer_t* display_renderer_create(uint32_t frame_width, uint32_t frame_height,
                                              uint32_t window_width, uint32_t window_height,
                                              const char* title);
 
+int display_renderer_set_decode(display_renderer_t* disp, int format);
+
+int display_renderer_decode_format(const display_renderer_t* disp);
+
 bool display_renderer_is_open(display_renderer_t* disp);
 
-int display_renderer_render(display_renderer_t* disp, const void* jpeg_data, size_t jpeg_len);
+void display_renderer_show(display_renderer_t* disp, jpeg_image_t* image);
+
+int display_renderer_present(display_renderer_t* disp, uint64_t* timestamp_us);
+
+const display_renderer_stats_t* display_renderer_stats(const display_renderer_t* disp);
 
 void display_renderer_destroy(display_renderer_t* disp);
 
@@ -1,19 +1,44 @@
 #ifndef FRAME_PIPE_H
 #define FRAME_PIPE_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#define FRAME_PIPE_HEADER_SIZE 12
+#define FRAME_PIPE_POLL_MS 100
+#define FRAME_PIPE_STALL_MS 1000
+
+typedef struct {
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t oversize;
+    uint64_t bytes;
+    uint64_t writes;
+    uint64_t stalls;
+} frame_pipe_stats_t;
+
 typedef struct {
     int fd;
-    uint32_t chunk_size;
+    int fd_flags;
+    uint32_t capacity;
+    uint32_t page_size;
+    atomic_bool closing;
+    bool broken;
+    frame_pipe_stats_t stats;
 } frame_pipe_t;
 
-frame_pipe_t* frame_pipe_create(int fd, uint32_t chunk_size);
+frame_pipe_t* frame_pipe_create(int fd, uint32_t pipe_size);
 
+/* Returns 0 when the frame was written, 1 when it was dropped because the
+ * reader is behind or the frame cannot fit in the pipe, and -1 on error or
+ * once the pipe is broken. */
 int frame_pipe_write(frame_pipe_t* pipe, uint64_t timestamp_us,
                      const void* data, size_t data_len);
 
+void frame_pipe_close(frame_pipe_t* pipe);
+
 void frame_pipe_destroy(frame_pipe_t* pipe);
 
 #endif
@@ -0,0 +1,34 @@
+#ifndef FRAME_PLAYER_H
+#define FRAME_PLAYER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_PLAYER_READ_SIZE (1024 * 1024)
+
+typedef struct frame_player frame_player_t;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps_num;
+    uint32_t fps_den;
+    uint64_t start_us;
+    uint32_t index_entries;
+} frame_player_info_t;
+
+frame_player_t* frame_player_create(const char* filename);
+
+const frame_player_info_t* frame_player_info(const frame_player_t* player);
+
+int frame_player_read(frame_player_t* player, uint64_t* pts_us, const uint8_t** data, size_t* len);
+
+int frame_player_rewind(frame_player_t* player);
+
+int frame_player_seek(frame_player_t* player, uint64_t offset_us);
+
+int frame_player_index_start(const char* filename, uint64_t* start_us);
+
+void frame_player_destroy(frame_player_t* player);
+
+#endif
@@ -4,15 +4,46 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define FRAME_RECORDER_BUFFER_SIZE (1024 * 1024)
+#define FRAME_RECORDER_SYNC_DEFAULT_MS 1000
+#define FRAME_RECORDER_INDEX_INTERVAL_MS 1000
+#define FRAME_RECORDER_RETRY_MS 1000
+#define FRAME_RECORDER_INDEX_MAGIC "MJPGIDX1"
+
 typedef struct frame_recorder frame_recorder_t;
 
+typedef struct {
+    uint64_t frames;
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t writes;
+    uint64_t write_us;
+    uint64_t write_max_us;
+    uint64_t syncs;
+    uint64_t sync_us;
+    uint64_t sync_max_us;
+    uint64_t segments;
+} frame_recorder_stats_t;
+
 frame_recorder_t* frame_recorder_create(const char* filename,
                                          uint32_t width, uint32_t height,
                                          uint32_t fps_num, uint32_t fps_den);
 
+frame_recorder_t* frame_recorder_create_segmented(const char* filename,
+                                                   uint32_t width, uint32_t height,
+                                                   uint32_t fps_num, uint32_t fps_den,
+                                                   uint32_t segment_seconds, uint64_t segment_bytes);
+
+void frame_recorder_set_sync(frame_recorder_t* rec, uint32_t interval_ms);
+
 int frame_recorder_write(frame_recorder_t* rec, uint64_t timestamp_us,
                          const void* jpeg_data, size_t jpeg_len);
 
+const frame_recorder_stats_t* frame_recorder_stats(const frame_recorder_t* rec);
+
+int frame_recorder_segment_path(const char* filename, uint32_t number, const char* ext,
+                                char* path, size_t size);
+
 void frame_recorder_destroy(frame_recorder_t* rec);
 
 #endif
@@ -0,0 +1,70 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_POLICY_LATEST 1
+#define FRAME_POLICY_QUEUE 2
+#define FRAME_POLICY_SPILL 3
+
+#define FRAME_STAGE_CAPTURE 0
+#define FRAME_STAGE_DQBUF 1
+#define FRAME_STAGE_FIRST_PACKET 2
+#define FRAME_STAGE_LAST_PACKET 3
+#define FRAME_STAGE_COMPLETE 4
+#define FRAME_STAGE_READY 5
+#define FRAME_STAGE_COUNT 6
+
+typedef struct frame_ring frame_ring_t;
+typedef struct frame_queue frame_queue_t;
+
+typedef struct {
+    frame_ring_t* ring;
+    atomic_uint refs;
+    uint8_t* data;
+    size_t capacity;
+    size_t len;
+    uint64_t timestamp_us;
+    uint64_t stage_us[FRAME_STAGE_COUNT];
+    void* opaque;
+} frame_ref_t;
+
+typedef void (*frame_recycle_fn)(void* ctx, frame_ref_t* frame);
+
+frame_ring_t* frame_ring_create(uint32_t slot_count, size_t slot_size);
+
+frame_ring_t* frame_ring_create_borrowed(uint32_t slot_count, frame_recycle_fn recycle, void* ctx);
+
+frame_ref_t* frame_ring_acquire(frame_ring_t* ring);
+
+int frame_ref_reserve(frame_ref_t* frame, size_t size);
+
+void frame_ref_retain(frame_ref_t* frame);
+
+void frame_ref_release(frame_ref_t* frame);
+
+void frame_ring_destroy(frame_ring_t* ring);
+
+frame_queue_t* frame_queue_create(uint32_t depth, int policy);
+
+int frame_queue_push(frame_queue_t* queue, frame_ref_t* frame);
+
+int frame_queue_push_wait(frame_queue_t* queue, frame_ref_t* frame, int timeout_ms);
+
+int frame_queue_set_spill(frame_queue_t* queue, size_t max_bytes);
+
+frame_ref_t* frame_queue_pop(frame_queue_t* queue, int timeout_ms);
+
+void frame_queue_close(frame_queue_t* queue);
+
+uint64_t frame_queue_dropped(frame_queue_t* queue);
+
+uint64_t frame_queue_spilled(frame_queue_t* queue);
+
+size_t frame_queue_spill_peak(frame_queue_t* queue);
+
+void frame_queue_destroy(frame_queue_t* queue);
+
+#endif
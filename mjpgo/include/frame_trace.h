@@ -0,0 +1,17 @@
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <stdint.h>
+
+typedef struct frame_trace frame_trace_t;
+
+frame_trace_t* frame_trace_create(const char* filename);
+
+void frame_trace_name_track(frame_trace_t* trace, uint32_t track, const char* name);
+
+void frame_trace_span(frame_trace_t* trace, uint32_t track, const char* name,
+                      uint64_t frame_ts, uint64_t start_us, uint64_t end_us);
+
+void frame_trace_destroy(frame_trace_t* trace);
+
+#endif
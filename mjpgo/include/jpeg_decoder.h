@@ -1,20 +1,61 @@
 #ifndef JPEG_DECODER_H
 #define JPEG_DECODER_H
 
+#include "frame_ring.h"
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#define JPEG_DECODE_YUV 0
+#define JPEG_DECODE_RGB 1
+
+#define JPEG_DECODER_MAX_THREADS 16
+#define JPEG_DECODER_SLICE_MIN_PIXELS (1280 * 720)
+
+typedef struct jpeg_decoder jpeg_decoder_t;
+
 typedef struct {
-    void* tj_instance;
+    jpeg_decoder_t* dec;
+    atomic_uint refs;
+    uint8_t* data;
+    size_t capacity;
+    int format;
     uint32_t width;
     uint32_t height;
-    uint8_t* rgb_buffer;
-    size_t rgb_size;
-} jpeg_decoder_t;
+    uint8_t* planes[3];
+    int strides[3];
+    uint64_t timestamp_us;
+    uint64_t decode_us;
+    uint32_t worker;
+} jpeg_image_t;
+
+typedef void (*jpeg_image_sink_fn)(void* ctx, jpeg_image_t* image);
+
+typedef struct {
+    uint64_t decoded;
+    uint64_t sliced;
+    uint64_t failed;
+} jpeg_decoder_stats_t;
+
+jpeg_decoder_t* jpeg_decoder_create(uint32_t thread_count, uint32_t image_count,
+                                    uint32_t max_width, uint32_t max_height);
+
+int jpeg_decoder_set_slices(jpeg_decoder_t* dec, uint32_t max_slices);
+
+uint32_t jpeg_decoder_threads(const jpeg_decoder_t* dec);
+
+uint32_t jpeg_decoder_capacity(const jpeg_decoder_t* dec);
+
+int jpeg_decoder_submit(jpeg_decoder_t* dec, frame_ref_t* frame, int format,
+                        jpeg_image_sink_fn sink, void* ctx);
+
+void jpeg_image_retain(jpeg_image_t* image);
+
+void jpeg_image_release(jpeg_image_t* image);
 
-jpeg_decoder_t* jpeg_decoder_create(uint32_t width, uint32_t height);
+jpeg_decoder_stats_t jpeg_decoder_stats(jpeg_decoder_t* dec);
 
-int jpeg_decoder_decode(jpeg_decoder_t* dec, const void* jpeg_data, size_t jpeg_len);
+void jpeg_decoder_close(jpeg_decoder_t* dec);
 
 void jpeg_decoder_destroy(jpeg_decoder_t* dec);
 
@@ -0,0 +1,27 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LATENCY_HISTOGRAM_SUB_BITS 5
+#define LATENCY_HISTOGRAM_SUB_COUNT (1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_BUCKETS ((64 - LATENCY_HISTOGRAM_SUB_BITS + 1) * LATENCY_HISTOGRAM_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} latency_histogram_t;
+
+void latency_histogram_reset(latency_histogram_t* hist);
+
+void latency_histogram_record(latency_histogram_t* hist, uint64_t value);
+
+uint64_t latency_histogram_percentile(const latency_histogram_t* hist, double percentile);
+
+void latency_histogram_print(const latency_histogram_t* hist, const char* title, const char* unit);
+
+#endif
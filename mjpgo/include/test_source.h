@@ -0,0 +1,34 @@
+#ifndef TEST_SOURCE_H
+#define TEST_SOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TEST_PATTERN_GRADIENT 0
+#define TEST_PATTERN_NOISE 1
+#define TEST_PATTERN_BOX 2
+
+#define TEST_SOURCE_FRAMES_DEFAULT 30
+
+typedef struct {
+    uint8_t** frames;
+    size_t* lengths;
+    uint32_t frame_count;
+    uint32_t next;
+    size_t min_len;
+    size_t max_len;
+    size_t total_len;
+    uint32_t width;
+    uint32_t height;
+} test_source_t;
+
+int test_source_pattern(const char* name);
+
+test_source_t* test_source_create(uint32_t width, uint32_t height, int quality,
+                                  int pattern, uint32_t frame_count);
+
+const uint8_t* test_source_next(test_source_t* src, size_t* len);
+
+void test_source_destroy(test_source_t* src);
+
+#endif
@@ -5,6 +5,20 @@
 #include <netinet/in.h>
 
 #define PACKET_HEADER_SIZE 20
+#define UDP_IP_HEADER_BYTES 28
+
+#define PACKET_FEC_FLAG 0x80000000u
+#define PACKET_FEC_K_SHIFT 16
+#define PACKET_FEC_K_MASK 0x7fffu
+#define PACKET_FEC_GROUP_MASK 0xffffu
+#define UDP_FEC_MAX_K 64
+
+#define PACKET_CONTROL_FLAG 0x40000000u
+#define PACKET_CONTROL_NACK 1u
+#define PACKET_CONTROL_PING 2u
+#define PACKET_CONTROL_PONG 3u
+#define PACKET_NACK_MAX_BYTES 128
+#define PACKET_PONG_BYTES 16
 
 typedef struct __attribute__((packed)) {
     uint64_t frame_ts_us;
@@ -21,5 +35,7 @@ typedef struct {
 int udp_create_socket(const char* ip, uint16_t port, udp_endpoint_t* out);
 void udp_close_socket(udp_endpoint_t* ep);
 uint64_t udp_get_time_us(void);
+uint32_t udp_fec_group_count(uint32_t seg_count, uint32_t fec_k);
+void udp_fec_xor(uint8_t* dst, const uint8_t* src, uint32_t len);
 
 #endif
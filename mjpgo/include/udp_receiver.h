@@ -2,12 +2,64 @@
 #define UDP_RECEIVER_H
 
 #include "udp_common.h"
+#include "clock_sync.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #define MAX_SEGMENTS_PER_FRAME 1024
 #define SEGMENT_BITMAP_SIZE (MAX_SEGMENTS_PER_FRAME / 64)
 
+#define UDP_RX_RECVFROM 0
+#define UDP_RX_MMSG 1
+#define UDP_RX_GRO 2
+#define UDP_RECEIVER_BATCH_DEFAULT 32
+#define UDP_GRO_BATCH_MAX 8
+#define UDP_GRO_BUFFER_SIZE 65536
+#define UDP_RECEIVER_SLOTS_DEFAULT 4
+#define UDP_RECEIVER_SLOTS_MAX 16
+#define UDP_RECEIVER_DEADLINE_DEFAULT_MS 100
+#define UDP_RECEIVER_RESET_US 1000000
+#define UDP_NACK_MAX_RETRIES 3
+#define UDP_CLOCK_PING_MS 1000
+#define UDP_CLOCK_FAST_PING_MS 100
+#define UDP_CLOCK_FAST_PINGS 8
+
+typedef struct {
+    uint64_t frames;
+    uint64_t packets;
+    uint64_t syscalls;
+    uint64_t copies;
+    uint64_t incomplete;
+    uint64_t stale;
+    uint64_t recovered;
+    uint64_t nacks;
+} udp_receiver_stats_t;
+
+typedef struct {
+    bool active;
+    uint32_t generation;
+    uint64_t ts;
+    uint64_t deadline_us;
+    uint32_t segments_received;
+    uint32_t segments_expected;
+    uint32_t next_seg;
+    uint32_t frame_len;
+    uint64_t segment_bitmap[SEGMENT_BITMAP_SIZE];
+    uint8_t* buf;
+    uint32_t fec_k;
+    uint32_t fec_groups;
+    uint64_t parity_bitmap[SEGMENT_BITMAP_SIZE];
+    uint8_t* parity;
+    uint32_t parity_capacity;
+    bool nack_ready;
+    uint32_t nacks_sent;
+    uint64_t nack_at_us;
+    uint64_t first_packet_us;
+    uint64_t last_packet_us;
+} udp_frame_slot_t;
+
 typedef struct {
     udp_endpoint_t local;
     uint32_t max_packet_size;
@@ -17,15 +69,56 @@ typedef struct {
     uint8_t* frame_buf;
     uint32_t frame_len;
     uint64_t frame_ts_us;
-    uint64_t tracked_ts;
-    uint32_t segments_received;
-    uint32_t segments_expected;
-    uint64_t segment_bitmap[SEGMENT_BITMAP_SIZE];
+    uint64_t frame_first_us;
+    uint64_t frame_last_us;
+    uint64_t packet_time_us;
+    bool packet_times;
+    udp_frame_slot_t* slots;
+    uint32_t slot_count;
+    uint64_t deadline_us;
+    udp_frame_slot_t* current;
+    uint64_t delivered_ts;
+    bool delivered_any;
+    struct sockaddr_in peer;
+    bool has_peer;
+    uint64_t nack_interval_us;
+    bool clock_enabled;
+    clock_sync_t clock;
+    uint64_t clock_ping_at_us;
+    uint32_t clock_pings;
+    int rx_mode;
+    uint32_t batch_size;
+    uint32_t batch_count;
+    uint32_t batch_next;
+    uint32_t batch_offset;
+    packet_header_t* batch_headers;
+    struct iovec* batch_iovs;
+    struct mmsghdr* batch_msgs;
+    uint8_t** batch_payloads;
+    bool* batch_placed;
+    uint8_t* batch_spill;
+    uint8_t* batch_control;
+    struct sockaddr_in* batch_addrs;
+    udp_frame_slot_t* batch_slot;
+    uint32_t batch_generation;
+    udp_receiver_stats_t stats;
 } udp_receiver_t;
 
 udp_receiver_t* udp_receiver_create(const char* local_ip, uint16_t local_port,
                                      uint32_t max_packet_size, uint32_t max_frame_size);
 
+int udp_receiver_set_rx_mode(udp_receiver_t* receiver, int rx_mode, uint32_t batch_size);
+
+int udp_receiver_set_window(udp_receiver_t* receiver, uint32_t slot_count, uint32_t deadline_ms);
+
+int udp_receiver_set_nack(udp_receiver_t* receiver, uint32_t interval_ms);
+
+int udp_receiver_set_clock_sync(udp_receiver_t* receiver, bool enabled);
+
+int udp_receiver_set_packet_times(udp_receiver_t* receiver, bool enabled);
+
+uint64_t udp_receiver_local_time(const udp_receiver_t* receiver, uint64_t remote_us);
+
 bool udp_receiver_get_frame(udp_receiver_t* receiver);
 
 void udp_receiver_destroy(udp_receiver_t* receiver);
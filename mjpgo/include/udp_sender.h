@@ -2,7 +2,46 @@
 #define UDP_SENDER_H
 
 #include "udp_common.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define UDP_TX_COPY 0
+#define UDP_TX_MMSG 1
+#define UDP_TX_GSO 2
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_BYTES 65507
+#define UDP_SENDER_ZEROCOPY_DEFAULT (256 * 1024)
+#define UDP_SENDER_CACHE_FRAMES 4
+#define UDP_SENDER_FEEDBACK_POLL_MS 100
+#define UDP_SENDER_BURST_DEFAULT (16 * 1024)
+
+typedef struct {
+    uint64_t frames;
+    uint64_t syscalls;
+    uint64_t cpu_ns;
+    uint64_t zerocopy_frames;
+    uint64_t zerocopy_sends;
+    uint64_t zerocopy_copied;
+    uint64_t fec_packets;
+    _Atomic uint64_t nacks;
+    _Atomic uint64_t retransmits;
+    _Atomic uint64_t nacks_expired;
+    _Atomic uint64_t pongs;
+    uint64_t pace_delay_us;
+    uint64_t pace_delay_max_us;
+} udp_sender_stats_t;
+
+typedef struct {
+    uint64_t ts;
+    uint64_t sent_us;
+    uint32_t len;
+    uint32_t seg_count;
+    uint8_t* data;
+} udp_sent_frame_t;
 
 typedef struct {
     udp_endpoint_t local;
@@ -11,12 +50,51 @@ typedef struct {
     uint32_t max_payload_per_packet;
     uint32_t max_frame_size;
     uint8_t* packet_buf;
+    int tx_mode;
+    uint32_t max_packets;
+    uint32_t gso_segments;
+    packet_header_t* headers;
+    struct iovec* iovs;
+    struct mmsghdr* msgs;
+    bool zerocopy;
+    uint32_t zerocopy_threshold;
+    uint32_t zerocopy_issued;
+    uint32_t zerocopy_completed;
+    uint32_t fec_k;
+    uint8_t* fec_parity;
+    uint32_t* fec_lens;
+    uint32_t fec_groups;
+    uint64_t pace_bytes_per_s;
+    uint32_t pace_burst;
+    int64_t pace_tokens;
+    uint64_t pace_refill_us;
+    uint64_t pace_frame_delay_us;
+    pthread_mutex_t pace_lock;
+    uint64_t nack_deadline_us;
+    bool clock_enabled;
+    udp_sent_frame_t cache[UDP_SENDER_CACHE_FRAMES];
+    uint32_t cache_next;
+    uint8_t* retransmit_buf;
+    pthread_mutex_t cache_lock;
+    pthread_t feedback_thread;
+    atomic_bool feedback_running;
+    udp_sender_stats_t stats;
 } udp_sender_t;
 
 udp_sender_t* udp_sender_create(const char* local_ip, uint16_t local_port,
                                  const char* remote_ip, uint16_t remote_port,
                                  uint32_t max_packet_size, uint32_t max_frame_size);
 
+int udp_sender_set_tx_mode(udp_sender_t* sender, int tx_mode, uint32_t zerocopy_threshold);
+
+int udp_sender_set_fec(udp_sender_t* sender, uint32_t fec_k);
+
+int udp_sender_set_nack(udp_sender_t* sender, uint32_t deadline_ms);
+
+int udp_sender_set_clock_sync(udp_sender_t* sender, bool enabled);
+
+int udp_sender_set_pacing(udp_sender_t* sender, uint64_t bits_per_s, uint32_t burst_bytes);
+
 int udp_sender_transmit(udp_sender_t* sender, uint64_t timestamp_us,
                         const void* frame_data, uint32_t frame_len,
                         uint32_t repeat_count);
@@ -1,21 +1,30 @@
 #ifndef VIDEO_CAPTURER_H
 #define VIDEO_CAPTURER_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-#define CAPTURER_BUFFER_COUNT 4
+#define CAPTURER_BUFFER_COUNT_DEFAULT 4
+#define CAPTURER_BUFFER_COUNT_MIN 2
+#define CAPTURER_BUFFER_COUNT_MAX 32
 
 typedef struct {
     void* data;
     size_t length;
     size_t used;
     uint64_t timestamp_us;
+    uint32_t index;
 } capture_buffer_t;
 
 typedef struct {
     int device_fd;
-    capture_buffer_t buffers[CAPTURER_BUFFER_COUNT];
+    capture_buffer_t* buffers;
+    uint32_t buffer_count;
+    atomic_uint queued_count;
+    bool latest_only;
+    uint64_t stale_frames;
     int active_index;
     uint64_t epoch_offset_us;
     uint32_t width;
@@ -24,7 +33,18 @@ typedef struct {
 
 video_capturer_t* video_capturer_create(const char* device_path,
                                          uint32_t width, uint32_t height,
-                                         uint32_t fps_num, uint32_t fps_den);
+                                         uint32_t fps_num, uint32_t fps_den,
+                                         uint32_t buffer_count);
+
+int video_capturer_set_nonblocking(video_capturer_t* cap, bool nonblocking);
+
+void video_capturer_set_latest_only(video_capturer_t* cap, bool latest_only);
+
+int video_capturer_dequeue(video_capturer_t* cap, capture_buffer_t** out);
+
+int video_capturer_requeue(video_capturer_t* cap, capture_buffer_t* buf);
+
+uint32_t video_capturer_queued(video_capturer_t* cap);
 
 int video_capturer_grab_frame(video_capturer_t* cap);
 
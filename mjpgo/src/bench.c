@@ -0,0 +1,1248 @@
+#define _GNU_SOURCE
+#include "../include/bench.h"
+#include "../include/frame_pipe.h"
+#include "../include/frame_recorder.h"
+#include "../include/frame_ring.h"
+#include "../include/jpeg_decoder.h"
+#include "../include/latency_histogram.h"
+#include "../include/test_source.h"
+#include "../include/udp_common.h"
+#include "../include/udp_sender.h"
+#include "../include/udp_receiver.h"
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <turbojpeg.h>
+#include <unistd.h>
+
+#define BENCH_RCVBUF_BYTES (8 * 1024 * 1024)
+#define BENCH_STOP_TS UINT64_MAX
+#define BENCH_STOP_RETRY_US 10000
+#define BENCH_RELAY_TIMEOUT_MS 100
+#define BENCH_NACK_INTERVAL_MS 5
+#define BENCH_NACK_DEADLINE_MS 50
+#define BENCH_RELAY_HELD_MAX 8192
+#define BENCH_REORDER_HOLD_US 1000
+#define BENCH_BURST_LEN_DEFAULT 10
+#define BENCH_SWEEP_MAX 8
+#define BENCH_EVICT_BYTES (64 * 1024 * 1024)
+#define BENCH_MICRO_SAMPLES 100000
+#define BENCH_MICRO_MIN_SAMPLES 5
+#define BENCH_MICRO_MAX_BYTES (128 * 1024 * 1024)
+#define BENCH_PIPE_SIZE (1024 * 1024)
+#define BENCH_MICRO_PACKET_LEN 1400
+#define BENCH_MICRO_TRUESIZE 2304
+
+typedef struct {
+    double loss;
+    double burst;
+    uint32_t burst_len;
+    double reorder;
+    double duplicate;
+    uint32_t delay_us;
+    uint32_t jitter_us;
+    uint32_t seed;
+} bench_impairment_t;
+
+typedef struct {
+    uint32_t frame_len;
+    uint32_t packet_len;
+    uint32_t fps;
+    double seconds;
+    uint32_t rounds;
+    int tx_mode;
+    int rx_mode;
+    uint32_t fec_k;
+    uint32_t nack_ms;
+    bool relay;
+    bench_impairment_t impair;
+} bench_config_t;
+
+typedef struct {
+    uint64_t frames_sent;
+    uint64_t frames_received;
+    uint64_t wire_bytes;
+    double seconds;
+    double sender_cpu_s;
+    double receiver_cpu_s;
+    udp_sender_stats_t tx;
+    udp_receiver_stats_t rx;
+    latency_histogram_t reassembly;
+    uint64_t relay_packets;
+    uint64_t relay_dropped;
+    uint64_t relay_duplicated;
+    uint64_t relay_reordered;
+    uint64_t relay_overflow;
+} bench_result_t;
+
+typedef struct {
+    uint64_t due_ns;
+    uint8_t* buf;
+    uint32_t len;
+    bool to_sender;
+} bench_held_t;
+
+typedef struct {
+    const bench_config_t* cfg;
+    udp_sender_t* sender;
+    udp_receiver_t* receiver;
+    uint8_t* frame;
+    atomic_bool receiver_done;
+    udp_endpoint_t relay;
+    struct sockaddr_in relay_target;
+    struct sockaddr_in relay_sender;
+    bool relay_has_sender;
+    atomic_bool relay_stop;
+    bench_held_t* held;
+    uint32_t held_count;
+    uint8_t* held_pool;
+    uint8_t** held_free;
+    uint32_t held_free_count;
+    bench_result_t* result;
+} bench_link_t;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double thread_cpu_s(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void* bench_receiver_thread(void* arg) {
+    bench_link_t* link = arg;
+    double cpu_start = thread_cpu_s();
+    
+    while (udp_receiver_get_frame(link->receiver)) {
+        if (link->receiver->frame_ts_us == BENCH_STOP_TS) break;
+        link->result->frames_received++;
+        latency_histogram_record(&link->result->reassembly,
+                                 udp_get_time_us() - link->receiver->frame_first_us);
+    }
+    
+    link->result->receiver_cpu_s = thread_cpu_s() - cpu_start;
+    atomic_store(&link->receiver_done, true);
+    return NULL;
+}
+
+static void* bench_sender_thread(void* arg) {
+    bench_link_t* link = arg;
+    const bench_config_t* cfg = link->cfg;
+    
+    uint64_t interval_ns = cfg->fps ? 1000000000ULL / cfg->fps : 0;
+    uint64_t start = mono_ns();
+    uint64_t end = start + (uint64_t)(cfg->seconds * 1e9);
+    uint64_t next = start;
+    double cpu_start = thread_cpu_s();
+    
+    for (uint64_t frame = 0; ; frame++) {
+        uint64_t now = mono_ns();
+        if (now >= end) break;
+        
+        if (interval_ns) {
+            if (next > now) {
+                struct timespec ts = { .tv_sec = next / 1000000000ULL, .tv_nsec = next % 1000000000ULL };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+            next += interval_ns;
+        }
+        
+        udp_sender_transmit(link->sender, frame + 1, link->frame, cfg->frame_len, cfg->rounds);
+        link->result->frames_sent++;
+    }
+    
+    link->result->sender_cpu_s = thread_cpu_s() - cpu_start;
+    link->result->seconds = (mono_ns() - start) / 1e9;
+    return NULL;
+}
+
+static bool relay_delays(const bench_impairment_t* imp) {
+    return imp->delay_us > 0 || imp->jitter_us > 0 || imp->reorder > 0;
+}
+
+static double relay_random(unsigned int* seed) {
+    return (double)rand_r(seed) / RAND_MAX;
+}
+
+/* Held datagrams form a min-heap on their release time, so jittered
+ * datagrams overtake each other just as they would on a real link. */
+static void relay_hold(bench_link_t* link, const uint8_t* buf, uint32_t len, bool to_sender, uint64_t due_ns) {
+    if (link->held_count == BENCH_RELAY_HELD_MAX) {
+        link->result->relay_overflow++;
+        return;
+    }
+    
+    bench_held_t entry = {
+        .due_ns = due_ns,
+        .buf = link->held_free[--link->held_free_count],
+        .len = len,
+        .to_sender = to_sender,
+    };
+    memcpy(entry.buf, buf, len);
+    
+    uint32_t i = link->held_count++;
+    while (i > 0 && link->held[(i - 1) / 2].due_ns > due_ns) {
+        link->held[i] = link->held[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    link->held[i] = entry;
+}
+
+static void relay_forward(bench_link_t* link, const uint8_t* buf, size_t len, bool to_sender) {
+    const struct sockaddr_in* dst = to_sender ? &link->relay_sender : &link->relay_target;
+    sendto(link->relay.sock_fd, buf, len, 0, (const struct sockaddr*)dst, sizeof(*dst));
+}
+
+static void relay_release(bench_link_t* link, uint64_t now_ns) {
+    while (link->held_count > 0 && link->held[0].due_ns <= now_ns) {
+        bench_held_t top = link->held[0];
+        relay_forward(link, top.buf, top.len, top.to_sender);
+        link->held_free[link->held_free_count++] = top.buf;
+        
+        bench_held_t last = link->held[--link->held_count];
+        uint32_t i = 0;
+        for (;;) {
+            uint32_t child = i * 2 + 1;
+            if (child >= link->held_count) break;
+            if (child + 1 < link->held_count && link->held[child + 1].due_ns < link->held[child].due_ns) child++;
+            if (link->held[child].due_ns >= last.due_ns) break;
+            link->held[i] = link->held[child];
+            i = child;
+        }
+        if (link->held_count > 0) link->held[i] = last;
+    }
+}
+
+/* Gilbert model: a burst starts with probability burst per datagram and
+ * loses every datagram until it ends, after burst_len datagrams on average. */
+static bool relay_drops(const bench_impairment_t* imp, unsigned int* seed, bool* bursting) {
+    bool lost = relay_random(seed) < imp->loss;
+    
+    if (imp->burst > 0) {
+        if (!*bursting && relay_random(seed) < imp->burst) *bursting = true;
+        if (*bursting) {
+            lost = true;
+            if (relay_random(seed) * imp->burst_len < 1.0) *bursting = false;
+        }
+    }
+    
+    return lost;
+}
+
+/* Stands in for a lossy tether: counts every datagram on the wire in
+ * either direction and forwards each one unless it is dropped, possibly
+ * duplicated, delayed or held back past its successors. Datagrams from
+ * the receiver are NACKs and go back to the sender. */
+static void* bench_relay_thread(void* arg) {
+    bench_link_t* link = arg;
+    const bench_impairment_t* imp = &link->cfg->impair;
+    unsigned int seed = imp->seed ? imp->seed : 1;
+    bool bursting = false;
+    bool delays = relay_delays(imp);
+    uint64_t stop_hold_ns = (imp->delay_us + imp->jitter_us + (imp->reorder > 0 ? BENCH_REORDER_HOLD_US : 0)) * 1000ULL;
+    uint8_t buf[UDP_GRO_BUFFER_SIZE];
+    
+    while (!atomic_load(&link->relay_stop)) {
+        uint64_t now = mono_ns();
+        struct timespec wait = { .tv_sec = 0, .tv_nsec = BENCH_RELAY_TIMEOUT_MS * 1000000L };
+        if (delays) {
+            relay_release(link, now);
+            if (link->held_count > 0 && link->held[0].due_ns - now < (uint64_t)wait.tv_nsec) {
+                wait.tv_nsec = link->held[0].due_ns - now;
+            }
+        }
+        
+        struct pollfd pfd = { .fd = link->relay.sock_fd, .events = POLLIN };
+        if (ppoll(&pfd, 1, &wait, NULL) <= 0) continue;
+        
+        struct sockaddr_in src;
+        socklen_t src_len = sizeof(src);
+        ssize_t len = recvfrom(link->relay.sock_fd, buf, sizeof(buf), MSG_DONTWAIT,
+                               (struct sockaddr*)&src, &src_len);
+        if (len < (ssize_t)PACKET_HEADER_SIZE) continue;
+        
+        bool from_receiver = src.sin_port == link->relay_target.sin_port;
+        if (!from_receiver) {
+            link->relay_sender = src;
+            link->relay_has_sender = true;
+        } else if (!link->relay_has_sender) {
+            continue;
+        }
+        
+        /* The stop frame is never impaired but trails the slowest datagram,
+         * so frames still held in the relay are not cut off. */
+        const packet_header_t* hdr = (const packet_header_t*)buf;
+        if (be64toh(hdr->frame_ts_us) == BENCH_STOP_TS) {
+            if (delays && len <= link->cfg->packet_len) {
+                relay_hold(link, buf, len, from_receiver, mono_ns() + stop_hold_ns);
+            } else {
+                relay_forward(link, buf, len, from_receiver);
+            }
+            continue;
+        }
+        
+        link->result->wire_bytes += len + UDP_IP_HEADER_BYTES;
+        link->result->relay_packets++;
+        if (relay_drops(imp, &seed, &bursting)) {
+            link->result->relay_dropped++;
+            continue;
+        }
+        
+        uint32_t copies = 1;
+        if (imp->duplicate > 0 && relay_random(&seed) < imp->duplicate) {
+            link->result->relay_duplicated++;
+            copies = 2;
+        }
+        
+        for (uint32_t c = 0; c < copies; c++) {
+            uint64_t hold_us = imp->delay_us;
+            if (imp->jitter_us > 0) hold_us += rand_r(&seed) % (imp->jitter_us + 1);
+            if (imp->reorder > 0 && relay_random(&seed) < imp->reorder) {
+                link->result->relay_reordered++;
+                hold_us += BENCH_REORDER_HOLD_US;
+            }
+            
+            if (hold_us == 0 || len > link->cfg->packet_len) {
+                relay_forward(link, buf, len, from_receiver);
+            } else {
+                relay_hold(link, buf, len, from_receiver, mono_ns() + hold_us * 1000);
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+static uint16_t bound_port(int sock_fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(sock_fd, (struct sockaddr*)&addr, &len) < 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+static int open_relay(bench_link_t* link) {
+    if (udp_create_socket("127.0.0.1", 0, &link->relay) < 0) return -1;
+    
+    int rcvbuf = BENCH_RCVBUF_BYTES;
+    setsockopt(link->relay.sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = BENCH_RELAY_TIMEOUT_MS * 1000 };
+    setsockopt(link->relay.sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    memset(&link->relay_target, 0, sizeof(link->relay_target));
+    link->relay_target.sin_family = AF_INET;
+    link->relay_target.sin_port = htons(bound_port(link->receiver->local.sock_fd));
+    link->relay_target.sin_addr.s_addr = inet_addr("127.0.0.1");
+    
+    if (!relay_delays(&link->cfg->impair)) return 0;
+    
+    link->held = calloc(BENCH_RELAY_HELD_MAX, sizeof(bench_held_t));
+    link->held_pool = malloc((size_t)BENCH_RELAY_HELD_MAX * link->cfg->packet_len);
+    link->held_free = calloc(BENCH_RELAY_HELD_MAX, sizeof(uint8_t*));
+    if (!link->held || !link->held_pool || !link->held_free) return -1;
+    
+    for (uint32_t i = 0; i < BENCH_RELAY_HELD_MAX; i++) {
+        link->held_free[i] = link->held_pool + (size_t)i * link->cfg->packet_len;
+    }
+    link->held_free_count = BENCH_RELAY_HELD_MAX;
+    return 0;
+}
+
+static void close_relay(bench_link_t* link) {
+    udp_close_socket(&link->relay);
+    free(link->held_free);
+    free(link->held_pool);
+    free(link->held);
+}
+
+static int run_link(const bench_config_t* cfg, bench_result_t* result) {
+    memset(result, 0, sizeof(*result));
+    latency_histogram_reset(&result->reassembly);
+    
+    bench_link_t link = { .cfg = cfg, .result = result };
+    atomic_init(&link.receiver_done, false);
+    atomic_init(&link.relay_stop, false);
+    link.relay.sock_fd = -1;
+    
+    link.receiver = udp_receiver_create("127.0.0.1", 0, cfg->packet_len, cfg->frame_len);
+    if (!link.receiver) return -1;
+    
+    int rcvbuf = BENCH_RCVBUF_BYTES;
+    setsockopt(link.receiver->local.sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    
+    if (cfg->relay && open_relay(&link) < 0) {
+        close_relay(&link);
+        udp_receiver_destroy(link.receiver);
+        return -1;
+    }
+    
+    int target_fd = cfg->relay ? link.relay.sock_fd : link.receiver->local.sock_fd;
+    link.sender = udp_sender_create("127.0.0.1", 0, "127.0.0.1", bound_port(target_fd),
+                                    cfg->packet_len, cfg->frame_len);
+    link.frame = malloc(cfg->frame_len);
+    
+    if (!link.sender || !link.frame ||
+        udp_sender_set_tx_mode(link.sender, cfg->tx_mode, UDP_SENDER_ZEROCOPY_DEFAULT) < 0 ||
+        udp_sender_set_fec(link.sender, cfg->fec_k) < 0 ||
+        udp_sender_set_nack(link.sender, cfg->nack_ms ? BENCH_NACK_DEADLINE_MS : 0) < 0 ||
+        udp_receiver_set_nack(link.receiver, cfg->nack_ms) < 0 ||
+        udp_receiver_set_packet_times(link.receiver, true) < 0 ||
+        udp_receiver_set_rx_mode(link.receiver, cfg->rx_mode, UDP_RECEIVER_BATCH_DEFAULT) < 0) {
+        free(link.frame);
+        udp_sender_destroy(link.sender);
+        close_relay(&link);
+        udp_receiver_destroy(link.receiver);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < cfg->frame_len; i++) {
+        link.frame[i] = (uint8_t)(i * 131 + 7);
+    }
+    
+    pthread_t rx_thread, tx_thread, relay_thread;
+    pthread_create(&rx_thread, NULL, bench_receiver_thread, &link);
+    if (cfg->relay) pthread_create(&relay_thread, NULL, bench_relay_thread, &link);
+    pthread_create(&tx_thread, NULL, bench_sender_thread, &link);
+    pthread_join(tx_thread, NULL);
+    
+    uint8_t stop = 0;
+    while (!atomic_load(&link.receiver_done)) {
+        udp_sender_transmit(link.sender, BENCH_STOP_TS, &stop, 1, 1);
+        usleep(BENCH_STOP_RETRY_US);
+    }
+    pthread_join(rx_thread, NULL);
+    
+    if (cfg->relay) {
+        atomic_store(&link.relay_stop, true);
+        pthread_join(relay_thread, NULL);
+    }
+    
+    result->tx = link.sender->stats;
+    result->rx = link.receiver->stats;
+    
+    free(link.frame);
+    udp_sender_destroy(link.sender);
+    close_relay(&link);
+    udp_receiver_destroy(link.receiver);
+    return 0;
+}
+
+static uint32_t arg_or(int argc, char** argv, int idx, uint32_t fallback) {
+    return idx < argc ? (uint32_t)atoi(argv[idx]) : fallback;
+}
+
+static int bench_offload(int argc, char** argv, int arg_start) {
+    static const struct {
+        const char* name;
+        int tx_mode;
+        int rx_mode;
+    } cases[] = {
+        { "copy/recvfrom", UDP_TX_COPY, UDP_RX_RECVFROM },
+        { "mmsg/mmsg",     UDP_TX_MMSG, UDP_RX_MMSG },
+        { "gso/recvfrom",  UDP_TX_GSO,  UDP_RX_RECVFROM },
+        { "gso/gro",       UDP_TX_GSO,  UDP_RX_GRO },
+    };
+    
+    bench_config_t cfg = {
+        .frame_len = arg_or(argc, argv, arg_start, 500000),
+        .packet_len = arg_or(argc, argv, arg_start + 1, 1400),
+        .fps = arg_or(argc, argv, arg_start + 2, 0),
+        .seconds = arg_or(argc, argv, arg_start + 3, 3),
+        .rounds = 1,
+    };
+    
+    if (cfg.packet_len <= PACKET_HEADER_SIZE || cfg.frame_len == 0 || cfg.seconds <= 0) {
+        fprintf(stderr, "bench offload requires: [FRAME_LEN PACKET_LEN FPS SECONDS]\n");
+        return 1;
+    }
+    
+    uint32_t payload = cfg.packet_len - PACKET_HEADER_SIZE;
+    uint32_t seg_count = (cfg.frame_len + payload - 1) / payload;
+    if (seg_count > MAX_SEGMENTS_PER_FRAME) {
+        fprintf(stderr, "Frame needs %u segments, limit is %u\n", seg_count, MAX_SEGMENTS_PER_FRAME);
+        return 1;
+    }
+    
+    printf("Loopback offload benchmark: %u byte frames, %u byte packets, %s, %.0f s per mode\n\n",
+           cfg.frame_len, cfg.packet_len, cfg.fps ? "paced" : "unpaced", cfg.seconds);
+    printf("%-14s %10s %12s %10s %10s %9s %9s %10s\n", "tx/rx", "frames/s", "packets/s",
+           "delivered", "tx CPU%", "rx CPU%", "tx calls", "rx calls");
+    
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        cfg.tx_mode = cases[i].tx_mode;
+        cfg.rx_mode = cases[i].rx_mode;
+        
+        bench_result_t res;
+        if (run_link(&cfg, &res) < 0) {
+            printf("%-14s unsupported on this kernel\n", cases[i].name);
+            continue;
+        }
+        
+        double delivered = res.frames_sent ? 100.0 * res.frames_received / res.frames_sent : 0;
+        printf("%-14s %10.1f %12.0f %9.1f%% %9.1f%% %8.1f%% %9.1f %10.1f\n", cases[i].name,
+               res.frames_received / res.seconds,
+               (double)res.frames_sent * seg_count / res.seconds,
+               delivered,
+               100.0 * res.sender_cpu_s / res.seconds,
+               100.0 * res.receiver_cpu_s / res.seconds,
+               res.tx.frames ? (double)res.tx.syscalls / res.tx.frames : 0,
+               res.rx.frames ? (double)res.rx.syscalls / res.rx.frames : 0);
+    }
+    
+    return 0;
+}
+
+static int bench_fec(int argc, char** argv, int arg_start) {
+    static const double losses[] = { 0.01, 0.05, 0.10 };
+    static const struct {
+        const char* name;
+        uint32_t rounds;
+        uint32_t fec_k;
+        uint32_t nack_ms;
+    } cases[] = {
+        { "none",     1, 0, 0 },
+        { "rounds=2", 2, 0, 0 },
+        { "fec=8",    1, 8, 0 },
+        { "fec=4",    1, 4, 0 },
+        { "nack",     1, 0, BENCH_NACK_INTERVAL_MS },
+        { "fec=8+nack", 1, 8, BENCH_NACK_INTERVAL_MS },
+    };
+    
+    bench_config_t cfg = {
+        .frame_len = arg_or(argc, argv, arg_start, 100000),
+        .packet_len = arg_or(argc, argv, arg_start + 1, 1400),
+        .fps = arg_or(argc, argv, arg_start + 2, 100),
+        .seconds = arg_or(argc, argv, arg_start + 3, 3),
+        .tx_mode = UDP_TX_COPY,
+        .rx_mode = UDP_RX_RECVFROM,
+        .relay = true,
+    };
+    
+    if (cfg.packet_len <= PACKET_HEADER_SIZE || cfg.frame_len == 0 || cfg.fps == 0 || cfg.seconds <= 0) {
+        fprintf(stderr, "bench fec requires: [FRAME_LEN PACKET_LEN FPS SECONDS]\n");
+        return 1;
+    }
+    
+    printf("Loss recovery benchmark: %u byte frames, %u byte packets, %u fps, %.0f s per case\n\n",
+           cfg.frame_len, cfg.packet_len, cfg.fps, cfg.seconds);
+    printf("%-6s %-10s %14s %10s %10s\n", "loss", "protection", "wire B/frame", "overhead", "delivered");
+    
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            cfg.impair.loss = losses[l];
+            cfg.rounds = cases[i].rounds;
+            cfg.fec_k = cases[i].fec_k;
+            cfg.nack_ms = cases[i].nack_ms;
+            
+            bench_result_t res;
+            if (run_link(&cfg, &res) < 0 || res.frames_sent == 0) {
+                printf("%-6.0f %-10s failed\n", cfg.impair.loss * 100, cases[i].name);
+                continue;
+            }
+            
+            double wire_per_frame = (double)res.wire_bytes / res.frames_sent;
+            printf("%4.0f%%  %-10s %14.0f %9.1f%% %9.1f%%\n", cfg.impair.loss * 100, cases[i].name,
+                   wire_per_frame,
+                   100.0 * (wire_per_frame / cfg.frame_len - 1.0),
+                   100.0 * res.frames_received / res.frames_sent);
+        }
+    }
+    
+    return 0;
+}
+
+static const char* bench_option(const char* arg, const char* key) {
+    size_t len = strlen(key);
+    return strncmp(arg, key, len) == 0 && arg[len] == '=' ? arg + len + 1 : NULL;
+}
+
+static uint32_t parse_sweep(const char* val, uint32_t* out) {
+    uint32_t count = 0;
+    
+    while (*val && count < BENCH_SWEEP_MAX) {
+        char* end;
+        unsigned long v = strtoul(val, &end, 10);
+        if (end == val || v == 0 || (*end && *end != ',')) return 0;
+        out[count++] = (uint32_t)v;
+        val = *end ? end + 1 : end;
+    }
+    
+    return *val ? 0 : count;
+}
+
+static int parse_transport_option(const char* arg, bench_config_t* cfg, uint32_t sweeps[3][BENCH_SWEEP_MAX],
+                                  uint32_t counts[3], const char** json_path) {
+    static const char* sweep_keys[3] = { "frame", "packet", "rounds" };
+    bench_impairment_t* imp = &cfg->impair;
+    const char* val;
+    
+    for (int i = 0; i < 3; i++) {
+        if ((val = bench_option(arg, sweep_keys[i])) != NULL) {
+            counts[i] = parse_sweep(val, sweeps[i]);
+            return counts[i] > 0 ? 0 : -1;
+        }
+    }
+    
+    if ((val = bench_option(arg, "fps")) != NULL) cfg->fps = atoi(val);
+    else if ((val = bench_option(arg, "seconds")) != NULL) cfg->seconds = atof(val);
+    else if ((val = bench_option(arg, "loss")) != NULL) imp->loss = atof(val) / 100;
+    else if ((val = bench_option(arg, "burst")) != NULL) imp->burst = atof(val) / 100;
+    else if ((val = bench_option(arg, "burst_len")) != NULL) imp->burst_len = atoi(val);
+    else if ((val = bench_option(arg, "reorder")) != NULL) imp->reorder = atof(val) / 100;
+    else if ((val = bench_option(arg, "dup")) != NULL) imp->duplicate = atof(val) / 100;
+    else if ((val = bench_option(arg, "delay")) != NULL) imp->delay_us = atof(val) * 1000;
+    else if ((val = bench_option(arg, "jitter")) != NULL) imp->jitter_us = atof(val) * 1000;
+    else if ((val = bench_option(arg, "seed")) != NULL) imp->seed = atoi(val);
+    else if ((val = bench_option(arg, "json")) != NULL) *json_path = val;
+    else return -1;
+    
+    if (imp->loss < 0 || imp->burst < 0 || imp->reorder < 0 || imp->duplicate < 0 || imp->burst_len == 0) return -1;
+    return 0;
+}
+
+static void print_transport_json(FILE* out, const bench_config_t* cfg, const bench_result_t* res) {
+    fprintf(out, "    {\"frame_len\": %u, \"packet_len\": %u, \"rounds\": %u, ",
+            cfg->frame_len, cfg->packet_len, cfg->rounds);
+    if (!res) {
+        fprintf(out, "\"error\": \"failed\"}");
+        return;
+    }
+    
+    const latency_histogram_t* lat = &res->reassembly;
+    fprintf(out, "\"frames_sent\": %lu, \"frames_received\": %lu, \"fps\": %.2f, \"completion\": %.4f, ",
+            res->frames_sent, res->frames_received, res->frames_received / res->seconds,
+            res->frames_sent ? (double)res->frames_received / res->frames_sent : 0);
+    fprintf(out, "\"reassembly_p50_us\": %lu, \"reassembly_p99_us\": %lu, \"reassembly_max_us\": %lu, ",
+            latency_histogram_percentile(lat, 50), latency_histogram_percentile(lat, 99), lat->count ? lat->max : 0);
+    fprintf(out, "\"tx_cpu_us_per_frame\": %.1f, \"rx_cpu_us_per_frame\": %.1f, ",
+            res->frames_sent ? res->sender_cpu_s * 1e6 / res->frames_sent : 0,
+            res->frames_received ? res->receiver_cpu_s * 1e6 / res->frames_received : 0);
+    fprintf(out, "\"packets\": %lu, \"dropped\": %lu, \"duplicated\": %lu, \"reordered\": %lu, "
+            "\"overflow\": %lu, \"incomplete\": %lu, \"recovered\": %lu}",
+            res->relay_packets, res->relay_dropped, res->relay_duplicated, res->relay_reordered,
+            res->relay_overflow, res->rx.incomplete, res->rx.recovered);
+}
+
+/* Every combination of frame size, packet size and ROUNDS runs through the
+ * same impaired relay with the same seed, so two runs on one machine see the
+ * same loss pattern and differ only by the transport settings under test. */
+static int bench_transport(int argc, char** argv, int arg_start) {
+    uint32_t sweeps[3][BENCH_SWEEP_MAX] = { { 100000, 500000 }, { 1400, 8192 }, { 1, 2 } };
+    uint32_t counts[3] = { 2, 2, 2 };
+    const char* json_path = NULL;
+    
+    bench_config_t cfg = {
+        .fps = 60,
+        .seconds = 2,
+        .tx_mode = UDP_TX_COPY,
+        .rx_mode = UDP_RX_RECVFROM,
+        .relay = true,
+        .impair = { .burst_len = BENCH_BURST_LEN_DEFAULT, .seed = 1 },
+    };
+    
+    for (int i = arg_start; i < argc; i++) {
+        if (parse_transport_option(argv[i], &cfg, sweeps, counts, &json_path) < 0 || cfg.seconds <= 0) {
+            fprintf(stderr, "Invalid bench transport option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    FILE* json = NULL;
+    if (json_path) {
+        json = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!json) {
+            fprintf(stderr, "Failed to open %s: %s\n", json_path, strerror(errno));
+            return 1;
+        }
+    }
+    
+    /* With the JSON on stdout the table moves to stderr. */
+    FILE* table = json == stdout ? stderr : stdout;
+    const bench_impairment_t* imp = &cfg.impair;
+    
+    fprintf(table, "Transport benchmark: %u fps, %.1f s per case, seed %u\n", cfg.fps, cfg.seconds, imp->seed);
+    fprintf(table, "Impairment: loss %.2f%%, burst %.2f%% x %u, reorder %.2f%%, dup %.2f%%, delay %.1f ms, jitter %.1f ms\n\n",
+            imp->loss * 100, imp->burst * 100, imp->burst_len, imp->reorder * 100, imp->duplicate * 100,
+            imp->delay_us / 1000.0, imp->jitter_us / 1000.0);
+    fprintf(table, "%9s %7s %6s %9s %9s %9s %9s %10s %10s\n", "frame", "packet", "rounds",
+            "fps", "complete", "p50 us", "p99 us", "tx us/fr", "rx us/fr");
+    
+    if (json) {
+        fprintf(json, "{\n  \"fps\": %u, \"seconds\": %.1f, \"seed\": %u,\n", cfg.fps, cfg.seconds, imp->seed);
+        fprintf(json, "  \"impairment\": {\"loss\": %.4f, \"burst\": %.4f, \"burst_len\": %u, \"reorder\": %.4f, "
+                "\"duplicate\": %.4f, \"delay_us\": %u, \"jitter_us\": %u},\n  \"runs\": [\n",
+                imp->loss, imp->burst, imp->burst_len, imp->reorder, imp->duplicate, imp->delay_us, imp->jitter_us);
+    }
+    
+    bool first = true;
+    for (uint32_t f = 0; f < counts[0]; f++) {
+        for (uint32_t p = 0; p < counts[1]; p++) {
+            for (uint32_t r = 0; r < counts[2]; r++) {
+                cfg.frame_len = sweeps[0][f];
+                cfg.packet_len = sweeps[1][p];
+                cfg.rounds = sweeps[2][r];
+                
+                uint32_t payload = cfg.packet_len > PACKET_HEADER_SIZE ? cfg.packet_len - PACKET_HEADER_SIZE : 0;
+                if (payload == 0 || (cfg.frame_len + payload - 1) / payload > MAX_SEGMENTS_PER_FRAME) {
+                    fprintf(table, "%9u %7u %6u needs more than %u segments, skipped\n",
+                            cfg.frame_len, cfg.packet_len, cfg.rounds, MAX_SEGMENTS_PER_FRAME);
+                    continue;
+                }
+                
+                bench_result_t res;
+                bool ok = run_link(&cfg, &res) == 0 && res.frames_sent > 0;
+                if (!ok) {
+                    fprintf(table, "%9u %7u %6u failed\n", cfg.frame_len, cfg.packet_len, cfg.rounds);
+                } else {
+                    fprintf(table, "%9u %7u %6u %9.1f %8.1f%% %9lu %9lu %10.1f %10.1f\n",
+                            cfg.frame_len, cfg.packet_len, cfg.rounds,
+                            res.frames_received / res.seconds,
+                            100.0 * res.frames_received / res.frames_sent,
+                            latency_histogram_percentile(&res.reassembly, 50),
+                            latency_histogram_percentile(&res.reassembly, 99),
+                            res.sender_cpu_s * 1e6 / res.frames_sent,
+                            res.frames_received ? res.receiver_cpu_s * 1e6 / res.frames_received : 0);
+                }
+                
+                if (json) {
+                    fprintf(json, "%s", first ? "" : ",\n");
+                    print_transport_json(json, &cfg, ok ? &res : NULL);
+                    first = false;
+                }
+            }
+        }
+    }
+    
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        if (json != stdout) fclose(json);
+    }
+    return 0;
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    bool ready;
+    uint64_t decode_us;
+} bench_decode_t;
+
+static void bench_decode_sink(void* ctx, jpeg_image_t* image) {
+    bench_decode_t* bd = ctx;
+    pthread_mutex_lock(&bd->lock);
+    bd->decode_us = image->decode_us;
+    bd->ready = true;
+    pthread_cond_signal(&bd->done);
+    pthread_mutex_unlock(&bd->lock);
+}
+
+/* Decodes the same frame back to back for the given time and returns the
+ * mean decode time in ms, or a negative value if a decode failed. */
+static double run_decode(const frame_ref_t* src, uint32_t width, uint32_t height, uint32_t threads,
+                         uint32_t slices, int format, double seconds, uint64_t* sliced) {
+    jpeg_decoder_t* dec = jpeg_decoder_create(threads, threads * 2 + 1, width, height);
+    frame_ring_t* ring = frame_ring_create(2, src->len);
+    if (!dec || !ring || jpeg_decoder_set_slices(dec, slices) < 0) {
+        jpeg_decoder_destroy(dec);
+        frame_ring_destroy(ring);
+        return -1;
+    }
+    
+    bench_decode_t bd = { .ready = false };
+    pthread_mutex_init(&bd.lock, NULL);
+    pthread_cond_init(&bd.done, NULL);
+    
+    uint64_t total_us = 0;
+    uint64_t frames = 0;
+    uint64_t end = mono_ns() + (uint64_t)(seconds * 1e9);
+    
+    while (mono_ns() < end) {
+        frame_ref_t* frame = frame_ring_acquire(ring);
+        memcpy(frame->data, src->data, src->len);
+        frame->len = src->len;
+        
+        bd.ready = false;
+        int result = jpeg_decoder_submit(dec, frame, format, bench_decode_sink, &bd);
+        frame_ref_release(frame);
+        if (result != 0) break;
+        
+        pthread_mutex_lock(&bd.lock);
+        while (!bd.ready && jpeg_decoder_stats(dec).failed == 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec++;
+            pthread_cond_timedwait(&bd.done, &bd.lock, &ts);
+        }
+        bool ok = bd.ready;
+        pthread_mutex_unlock(&bd.lock);
+        if (!ok) break;
+        
+        total_us += bd.decode_us;
+        frames++;
+    }
+    
+    jpeg_decoder_stats_t stats = jpeg_decoder_stats(dec);
+    *sliced = stats.sliced;
+    jpeg_decoder_close(dec);
+    jpeg_decoder_destroy(dec);
+    frame_ring_destroy(ring);
+    pthread_cond_destroy(&bd.done);
+    pthread_mutex_destroy(&bd.lock);
+    
+    if (stats.failed > 0 || frames == 0) return -1;
+    return total_us / 1000.0 / frames;
+}
+
+static int bench_decode(int argc, char** argv, int arg_start) {
+    static const struct {
+        const char* name;
+        int format;
+    } formats[] = {
+        { "yuv", JPEG_DECODE_YUV },
+        { "rgb", JPEG_DECODE_RGB },
+    };
+    
+    if (arg_start >= argc) {
+        fprintf(stderr, "bench decode requires: FILE.jpg [SECONDS]\n");
+        return 1;
+    }
+    
+    const char* path = argv[arg_start];
+    double seconds = arg_or(argc, argv, arg_start + 1, 2);
+    
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    frame_ref_t src = { .len = size > 0 ? (size_t)size : 0 };
+    src.data = src.len ? malloc(src.len) : NULL;
+    bool read_ok = src.data && fread(src.data, 1, src.len, f) == src.len;
+    fclose(f);
+    
+    int width = 0, height = 0, subsamp, colorspace;
+    tjhandle tj = tjInitDecompress();
+    bool header_ok = read_ok && tj &&
+                     tjDecompressHeader3(tj, src.data, src.len, &width, &height, &subsamp, &colorspace) == 0;
+    if (tj) tjDestroy(tj);
+    if (!header_ok) {
+        fprintf(stderr, "%s is not a readable JPEG\n", path);
+        free(src.data);
+        return 1;
+    }
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t max_threads = cpus > 0 ? (uint32_t)cpus : 1;
+    if (max_threads > JPEG_DECODER_MAX_THREADS) max_threads = JPEG_DECODER_MAX_THREADS;
+    
+    printf("Decode benchmark: %s, %dx%d, %zu bytes, %u CPUs, %.0f s per case\n\n",
+           path, width, height, src.len, max_threads, seconds);
+    printf("%-8s %-6s %12s %12s %9s\n", "threads", "format", "serial ms", "sliced ms", "speedup");
+    
+    for (uint32_t threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            uint64_t sliced = 0;
+            double serial_ms = run_decode(&src, width, height, threads, 1, formats[i].format, seconds, &sliced);
+            double sliced_ms = run_decode(&src, width, height, threads, threads, formats[i].format, seconds, &sliced);
+            if (serial_ms < 0 || sliced_ms < 0) {
+                printf("%-8u %-6s failed\n", threads, formats[i].name);
+            } else if (sliced == 0) {
+                printf("%-8u %-6s %12.2f %12s %9s\n", threads, formats[i].name, serial_ms, "-", "-");
+            } else {
+                printf("%-8u %-6s %12.2f %12.2f %8.2fx\n", threads, formats[i].name,
+                       serial_ms, sliced_ms, serial_ms / sliced_ms);
+            }
+        }
+        if (threads == max_threads) break;
+    }
+    
+    if (width * height < JPEG_DECODER_SLICE_MIN_PIXELS) {
+        printf("\nFrames below %d pixels are never sliced\n", JPEG_DECODER_SLICE_MIN_PIXELS);
+    }
+    
+    free(src.data);
+    return 0;
+}
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    tjhandle tj;
+    uint8_t* image;
+    const uint8_t* jpeg;
+    size_t jpeg_len;
+    udp_sender_t* sender;
+    udp_receiver_t* receiver;
+    uint64_t udp_ts;
+    frame_pipe_t* pipe;
+    frame_recorder_t* rec;
+    uint64_t rec_ts;
+} bench_micro_t;
+
+typedef struct {
+    uint64_t median_ns;
+    uint64_t p99_ns;
+    double mean_ns;
+} bench_micro_result_t;
+
+typedef struct {
+    const char* name;
+    int (*run)(bench_micro_t* m, const uint8_t* jpeg, size_t len);
+    void (*prepare)(bench_micro_t* m);
+} bench_micro_op_t;
+
+static int micro_decode_rgb(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    return tjDecompress2(m->tj, jpeg, len, m->image, m->width, m->width * 3, m->height,
+                         TJPF_RGB, TJFLAG_FASTDCT);
+}
+
+static int micro_decode_yuv(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    size_t plane = (size_t)m->width * m->height;
+    unsigned char* planes[3] = { m->image, m->image + plane, m->image + plane * 2 };
+    int strides[3] = { (int)m->width, (int)m->width, (int)m->width };
+    return tjDecompressToYUVPlanes(m->tj, jpeg, len, planes, m->width, strides, m->height,
+                                   TJFLAG_FASTDCT);
+}
+
+/* Empties the receiver's socket so every sample starts with room for a
+ * whole frame. */
+static void micro_udp_drain(bench_micro_t* m) {
+    uint8_t buf[BENCH_MICRO_PACKET_LEN];
+    while (recv(m->receiver->local.sock_fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {}
+}
+
+/* udp_sender_transmit() in copy mode to a receiver on 127.0.0.1, so this
+ * includes a sendto() per packet through the loopback device. */
+static int micro_send(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    return udp_sender_transmit(m->sender, ++m->udp_ts, jpeg, len, 1);
+}
+
+/* The frame is queued on the receiver's socket before the clock starts, so
+ * only the recvfrom() calls and the reassembly are timed. */
+static void micro_receive_prepare(bench_micro_t* m) {
+    micro_udp_drain(m);
+    udp_sender_transmit(m->sender, ++m->udp_ts, m->jpeg, m->jpeg_len, 1);
+}
+
+static int micro_receive(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    (void)jpeg;
+    if (!udp_receiver_get_frame(m->receiver)) return -1;
+    return m->receiver->frame_ts_us == m->udp_ts && m->receiver->frame_len == len ? 0 : -1;
+}
+
+/* The receive case blocks if the kernel drops part of a queued frame, so
+ * it only runs when the socket buffer holds every packet. */
+static bool micro_receive_fits(bench_micro_t* m, size_t len) {
+    int rcvbuf = 0;
+    socklen_t optlen = sizeof(rcvbuf);
+    if (getsockopt(m->receiver->local.sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) < 0) return false;
+    
+    size_t packets = (len + m->receiver->max_payload_per_packet - 1) / m->receiver->max_payload_per_packet;
+    return packets * BENCH_MICRO_TRUESIZE <= (size_t)rcvbuf;
+}
+
+/* A dropped frame would time nothing, so each sample starts with the
+ * pipe drained by the reader. */
+static void micro_pipe_drain(bench_micro_t* m) {
+    int queued;
+    while (ioctl(m->pipe->fd, FIONREAD, &queued) == 0 && queued > 0) sched_yield();
+}
+
+static int micro_pipe(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    return frame_pipe_write(m->pipe, 0, jpeg, len) == 0 ? 0 : -1;
+}
+
+static int micro_record(bench_micro_t* m, const uint8_t* jpeg, size_t len) {
+    m->rec_ts += 33333;
+    return frame_recorder_write(m->rec, m->rec_ts, jpeg, len);
+}
+
+static void* micro_drain_thread(void* arg) {
+    int fd = *(int*)arg;
+    uint8_t buf[65536];
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Writing every line of a buffer larger than the last level cache pushes
+ * the frame, the destination and the codec state out to memory. */
+static void evict_caches(uint8_t* evict) {
+    for (size_t i = 0; i < BENCH_EVICT_BYTES; i += 64) evict[i]++;
+}
+
+/* The median shows the usual cost; the p99 and the mean also catch work
+ * done only every so often, like the recorder flushing its buffer. A case
+ * stops after BENCH_MICRO_MAX_BYTES so the recorder cannot fill $TMPDIR.
+ * All zero if the operation failed. */
+static bench_micro_result_t run_micro(bench_micro_t* m, const bench_micro_op_t* op, const uint8_t* jpeg,
+                                      size_t len, uint8_t* evict, double seconds, uint64_t* samples) {
+    bench_micro_result_t res = {0};
+    if (op->prepare) op->prepare(m);
+    if (op->run(m, jpeg, len) < 0) return res;
+    
+    uint32_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_count = BENCH_MICRO_MAX_BYTES / len;
+    if (max_count > BENCH_MICRO_SAMPLES) max_count = BENCH_MICRO_SAMPLES;
+    if (max_count < BENCH_MICRO_MIN_SAMPLES) max_count = BENCH_MICRO_MIN_SAMPLES;
+    
+    uint64_t end = mono_ns() + (uint64_t)(seconds * 1e9);
+    while (count < max_count && (count < BENCH_MICRO_MIN_SAMPLES || mono_ns() < end)) {
+        if (op->prepare) op->prepare(m);
+        if (evict) evict_caches(evict);
+        uint64_t start = mono_ns();
+        if (op->run(m, jpeg, len) < 0) return res;
+        samples[count] = mono_ns() - start;
+        total_ns += samples[count++];
+    }
+    
+    qsort(samples, count, sizeof(samples[0]), compare_u64);
+    res.median_ns = samples[count / 2];
+    res.p99_ns = samples[(uint64_t)count * 99 / 100];
+    res.mean_ns = (double)total_ns / count;
+    return res;
+}
+
+static int load_jpeg(const char* path, uint8_t** data, size_t* len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    *len = size > 0 ? (size_t)size : 0;
+    *data = *len ? malloc(*len) : NULL;
+    bool ok = *data && fread(*data, 1, *len, f) == *len;
+    fclose(f);
+    if (!ok) free(*data);
+    return ok ? 0 : -1;
+}
+
+static void print_micro_result(const bench_micro_result_t* res, size_t len) {
+    if (res->mean_ns > 0) {
+        printf(" %10lu %10lu %10.0f %8.1f", res->median_ns, res->p99_ns, res->mean_ns, len * 1e3 / res->mean_ns);
+    } else {
+        printf(" %10s %10s %10s %8s", "failed", "-", "-", "-");
+    }
+}
+
+static void print_micro_row(const char* op, const bench_micro_result_t* warm,
+                            const bench_micro_result_t* cold, size_t len) {
+    printf("  %-11s", op);
+    print_micro_result(warm, len);
+    printf("  ");
+    print_micro_result(cold, len);
+    printf("\n");
+}
+
+static int bench_micro_frame(const char* label, const uint8_t* jpeg, size_t len, bench_micro_t* m,
+                             uint8_t* evict, double seconds, uint64_t* samples, const char* dir) {
+    static const bench_micro_op_t ops[] = {
+        { "decode rgb", micro_decode_rgb, NULL },
+        { "decode yuv", micro_decode_yuv, NULL },
+        { "send", micro_send, micro_udp_drain },
+        { "receive", micro_receive, micro_receive_prepare },
+        { "pipe", micro_pipe, micro_pipe_drain },
+        { "record", micro_record, NULL },
+    };
+    
+    int width, height, subsamp, colorspace;
+    if (tjDecompressHeader3(m->tj, jpeg, len, &width, &height, &subsamp, &colorspace) < 0) {
+        printf("%s: not a readable JPEG\n", label);
+        return -1;
+    }
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/mjpgo-bench-%d.mkv", dir, (int)getpid());
+    
+    m->width = width;
+    m->height = height;
+    m->image = malloc((size_t)width * height * 3);
+    m->jpeg = jpeg;
+    m->jpeg_len = len;
+    m->rec = frame_recorder_create(path, width, height, 1, 30);
+    m->rec_ts = 0;
+    if (m->rec) frame_recorder_set_sync(m->rec, 0);
+    
+    m->receiver = udp_receiver_create("127.0.0.1", 0, BENCH_MICRO_PACKET_LEN, len);
+    m->sender = m->receiver ? udp_sender_create("127.0.0.1", 0, "127.0.0.1", bound_port(m->receiver->local.sock_fd),
+                                                BENCH_MICRO_PACKET_LEN, len) : NULL;
+    if (m->receiver) {
+        int rcvbuf = BENCH_RCVBUF_BYTES;
+        if (setsockopt(m->receiver->local.sock_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+            setsockopt(m->receiver->local.sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+    }
+    
+    printf("%s: %dx%d, %zu bytes\n", label, width, height, len);
+    if (m->image) {
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            bool unavailable = (ops[i].run == micro_record && !m->rec) ||
+                               ((ops[i].run == micro_send || ops[i].run == micro_receive) && !m->sender) ||
+                               (ops[i].run == micro_receive && !micro_receive_fits(m, len));
+            if (unavailable) {
+                bench_micro_result_t failed = {0};
+                print_micro_row(ops[i].name, &failed, &failed, len);
+                continue;
+            }
+            bench_micro_result_t warm = run_micro(m, &ops[i], jpeg, len, NULL, seconds, samples);
+            bench_micro_result_t cold = run_micro(m, &ops[i], jpeg, len, evict, seconds, samples);
+            print_micro_row(ops[i].name, &warm, &cold, len);
+        }
+    }
+    printf("\n");
+    
+    frame_recorder_destroy(m->rec);
+    unlink(path);
+    udp_sender_destroy(m->sender);
+    udp_receiver_destroy(m->receiver);
+    free(m->image);
+    return 0;
+}
+
+/* Times the per-frame work of each stage on the given frames,
+ * or on synthetic frames at common camera resolutions. MB/s is JPEG bytes
+ * processed, so the figures compare directly across machines. */
+static int bench_micro(int argc, char** argv, int arg_start) {
+    static const uint32_t sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    
+    double seconds = arg_start < argc ? atof(argv[arg_start]) : 0.5;
+    if (seconds <= 0) {
+        fprintf(stderr, "bench micro requires: [SECONDS [FILE.jpg...]]\n");
+        return 1;
+    }
+    
+    const char* dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    bench_micro_t m = { .tj = tjInitDecompress() };
+    uint8_t* evict = malloc(BENCH_EVICT_BYTES);
+    uint64_t* samples = malloc(BENCH_MICRO_SAMPLES * sizeof(uint64_t));
+    
+    int fds[2] = { -1, -1 };
+    if (!m.tj || !evict || !samples || pipe(fds) < 0 ||
+        !(m.pipe = frame_pipe_create(fds[1], BENCH_PIPE_SIZE))) {
+        fprintf(stderr, "Failed to set up micro benchmark\n");
+        if (fds[0] >= 0) close(fds[0]);
+        if (fds[1] >= 0) close(fds[1]);
+        if (m.tj) tjDestroy(m.tj);
+        free(samples);
+        free(evict);
+        return 1;
+    }
+    memset(evict, 0, BENCH_EVICT_BYTES);
+    
+    pthread_t drain;
+    pthread_create(&drain, NULL, micro_drain_thread, &fds[0]);
+    
+    struct utsname un;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("Micro benchmark: %s, %ld CPUs, %.1f s per case, ns per frame, MB/s from the mean\n",
+           uname(&un) == 0 ? un.machine : "unknown", cpus, seconds);
+    printf("Cold runs write %d MiB between samples; send and receive use %d byte packets on 127.0.0.1, pipe holds %u bytes\n",
+           BENCH_EVICT_BYTES >> 20, BENCH_MICRO_PACKET_LEN, m.pipe->capacity);
+    printf("Each case stops after %d MiB of frames\n", BENCH_MICRO_MAX_BYTES >> 20);
+    if (arg_start + 1 >= argc) {
+        printf("No frames given: synthetic testsrc box frames at quality 85, smaller than camera frames\n");
+    }
+    printf("\n");
+    printf("  %-11s %-41s  %s\n", "", "warm", "cold");
+    printf("  %-11s %10s %10s %10s %8s  %10s %10s %10s %8s\n", "",
+           "median", "p99", "mean", "MB/s", "median", "p99", "mean", "MB/s");
+    
+    int result = 0;
+    if (arg_start + 1 < argc) {
+        for (int i = arg_start + 1; i < argc; i++) {
+            uint8_t* jpeg;
+            size_t len;
+            if (load_jpeg(argv[i], &jpeg, &len) < 0) {
+                fprintf(stderr, "Failed to read %s\n", argv[i]);
+                result = 1;
+                continue;
+            }
+            if (bench_micro_frame(argv[i], jpeg, len, &m, evict, seconds, samples, dir) < 0) result = 1;
+            free(jpeg);
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            test_source_t* src = test_source_create(sizes[i][0], sizes[i][1], 85, TEST_PATTERN_BOX, 1);
+            if (!src) {
+                printf("%ux%u: failed to encode\n\n", sizes[i][0], sizes[i][1]);
+                continue;
+            }
+            size_t len;
+            const uint8_t* jpeg = test_source_next(src, &len);
+            bench_micro_frame("synthetic box q85", jpeg, len, &m, evict, seconds, samples, dir);
+            test_source_destroy(src);
+        }
+    }
+    
+    close(fds[1]);
+    pthread_join(drain, NULL);
+    close(fds[0]);
+    frame_pipe_destroy(m.pipe);
+    tjDestroy(m.tj);
+    free(samples);
+    free(evict);
+    return result;
+}
+
+int bench_run(int argc, char** argv, int arg_start) {
+    if (arg_start >= argc) {
+        fprintf(stderr, "bench requires a suite: offload, fec, transport, decode, micro\n");
+        return 1;
+    }
+    
+    const char* suite = argv[arg_start];
+    
+    if (strcmp(suite, "offload") == 0) {
+        return bench_offload(argc, argv, arg_start + 1);
+    }
+    
+    if (strcmp(suite, "fec") == 0) {
+        return bench_fec(argc, argv, arg_start + 1);
+    }
+    
+    if (strcmp(suite, "transport") == 0) {
+        return bench_transport(argc, argv, arg_start + 1);
+    }
+    
+    if (strcmp(suite, "decode") == 0) {
+        return bench_decode(argc, argv, arg_start + 1);
+    }
+    
+    if (strcmp(suite, "micro") == 0) {
+        return bench_micro(argc, argv, arg_start + 1);
+    }
+    
+    fprintf(stderr, "Unknown bench suite: %s\n", suite);
+    return 1;
+}
@@ -0,0 +1,61 @@
+#include "../include/clock_sync.h"
+#include <string.h>
+
+void clock_sync_reset(clock_sync_t* cs) {
+    if (!cs) return;
+    memset(cs, 0, sizeof(*cs));
+}
+
+static const clock_sample_t* best_sample(const clock_sync_t* cs) {
+    const clock_sample_t* best = &cs->window[0];
+    for (uint32_t i = 1; i < cs->window_count; i++) {
+        if (cs->window[i].delay_us < best->delay_us) best = &cs->window[i];
+    }
+    return best;
+}
+
+/* NTP-style exchange: t1 and t4 are local send/receive times, t2 and t3 the
+ * remote receive/send times. The offset (remote minus local) comes from the
+ * lowest-delay sample of the last CLOCK_SYNC_WINDOW, since queueing only
+ * ever adds delay and skews the estimate; drift is smoothed over filtered
+ * samples at least CLOCK_SYNC_DRIFT_MIN_US apart. */
+bool clock_sync_add_sample(clock_sync_t* cs, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4) {
+    if (!cs || t4 < t1 || t3 < t2) return false;
+    
+    uint64_t round_trip = t4 - t1;
+    uint64_t remote_hold = t3 - t2;
+    if (remote_hold > round_trip) return false;
+    
+    clock_sample_t* s = &cs->window[cs->window_next];
+    s->offset_us = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    s->delay_us = round_trip - remote_hold;
+    s->at_us = t4;
+    cs->window_next = (cs->window_next + 1) % CLOCK_SYNC_WINDOW;
+    if (cs->window_count < CLOCK_SYNC_WINDOW) cs->window_count++;
+    cs->samples++;
+    
+    const clock_sample_t* best = best_sample(cs);
+    
+    if (!cs->valid) {
+        cs->anchor = *best;
+    } else if (best->at_us >= cs->anchor.at_us + CLOCK_SYNC_DRIFT_MIN_US) {
+        double drift = (double)(best->offset_us - cs->anchor.offset_us) /
+                       (double)(best->at_us - cs->anchor.at_us);
+        if (drift > CLOCK_SYNC_DRIFT_MAX) drift = CLOCK_SYNC_DRIFT_MAX;
+        if (drift < -CLOCK_SYNC_DRIFT_MAX) drift = -CLOCK_SYNC_DRIFT_MAX;
+        cs->drift = cs->drift_valid ? 0.75 * cs->drift + 0.25 * drift : drift;
+        cs->drift_valid = true;
+        cs->anchor = *best;
+    }
+    
+    cs->offset_us = best->offset_us;
+    cs->ref_us = best->at_us;
+    cs->delay_us = best->delay_us;
+    cs->valid = true;
+    return true;
+}
+
+int64_t clock_sync_offset_at(const clock_sync_t* cs, uint64_t local_us) {
+    if (!cs || !cs->valid) return 0;
+    return cs->offset_us + (int64_t)(cs->drift * (double)((int64_t)(local_us - cs->ref_us)));
+}
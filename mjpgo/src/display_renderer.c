@@ -1,20 +1,47 @@
 #include "../include/display_renderer.h"
 #include <SDL2/SDL.h>
-#include <turbojpeg.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+/* Decoded images arrive from the decoder threads and are shown by the SDL
+ * thread. Only the newest pending image is kept; with the one on screen and
+ * one being decoded that makes a triple buffer. */
 struct display_renderer {
     SDL_Window* window;
     SDL_Renderer* renderer;
     SDL_Texture* texture;
-    tjhandle tj_instance;
-    uint8_t* rgb_buffer;
+    SDL_Texture* yuv_texture;
+    SDL_Texture* shown;
+    pthread_mutex_t lock;
+    jpeg_image_t* pending;
+    jpeg_image_t* front;
+    uint64_t newest_ts;
     uint32_t frame_width;
     uint32_t frame_height;
+    _Atomic int decode_format;
+    display_renderer_stats_t stats;
     bool open;
 };
 
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* The IYUV texture is optional: without it every frame is decoded to RGB. */
+static SDL_Texture* create_yuv_texture(display_renderer_t* disp) {
+    return SDL_CreateTexture(
+        disp->renderer,
+        SDL_PIXELFORMAT_IYUV,
+        SDL_TEXTUREACCESS_STREAMING,
+        disp->frame_width, disp->frame_height
+    );
+}
+
 display_renderer_t* display_renderer_create(uint32_t frame_width, uint32_t frame_height,
                                              uint32_t window_width, uint32_t window_height,
                                              const char* title) {
@@ -69,31 +96,30 @@ display_renderer_t* display_renderer_create(uint32_t frame_width, uint32_t frame
         return NULL;
     }
     
-    disp->tj_instance = tjInitDecompress();
-    if (!disp->tj_instance) {
-        SDL_DestroyTexture(disp->texture);
-        SDL_DestroyRenderer(disp->renderer);
-        SDL_DestroyWindow(disp->window);
-        SDL_Quit();
-        free(disp);
-        return NULL;
-    }
-    
-    disp->rgb_buffer = tjAlloc(frame_width * frame_height * 3);
-    if (!disp->rgb_buffer) {
-        tjDestroy(disp->tj_instance);
-        SDL_DestroyTexture(disp->texture);
-        SDL_DestroyRenderer(disp->renderer);
-        SDL_DestroyWindow(disp->window);
-        SDL_Quit();
-        free(disp);
-        return NULL;
-    }
-    
+    disp->yuv_texture = create_yuv_texture(disp);
+    atomic_init(&disp->decode_format, disp->yuv_texture ? JPEG_DECODE_YUV : JPEG_DECODE_RGB);
+    pthread_mutex_init(&disp->lock, NULL);
     disp->open = true;
     return disp;
 }
 
+int display_renderer_set_decode(display_renderer_t* disp, int format) {
+    if (!disp) return -1;
+    if (format != JPEG_DECODE_YUV && format != JPEG_DECODE_RGB) return -1;
+    
+    if (!disp->yuv_texture) format = JPEG_DECODE_RGB;
+    atomic_store_explicit(&disp->decode_format, format, memory_order_relaxed);
+    return 0;
+}
+
+/* Read by the decoder threads while the SDL thread may be recreating the
+ * textures, so the format is kept apart from them and only ever falls back
+ * from YUV to RGB. */
+int display_renderer_decode_format(const display_renderer_t* disp) {
+    if (!disp) return JPEG_DECODE_RGB;
+    return atomic_load_explicit(&disp->decode_format, memory_order_relaxed);
+}
+
 bool display_renderer_is_open(display_renderer_t* disp) {
     if (!disp) return false;
     
@@ -110,43 +136,143 @@ bool display_renderer_is_open(display_renderer_t* disp) {
     return disp->open;
 }
 
-int display_renderer_render(display_renderer_t* disp, const void* jpeg_data, size_t jpeg_len) {
-    if (!disp || !jpeg_data || jpeg_len == 0) return -1;
-    if (!disp->open) return -1;
-    
-    int result = tjDecompress2(
-        disp->tj_instance,
-        (unsigned char*)jpeg_data,
-        jpeg_len,
-        disp->rgb_buffer,
-        disp->frame_width,
-        disp->frame_width * 3,
-        disp->frame_height,
-        TJPF_RGB,
-        TJFLAG_FASTDCT
-    );
+/* Called from any thread. Images older than one already accepted (decoder
+ * threads may finish out of order) and pending images replaced before they
+ * were presented count as skipped. A jump back of more than
+ * DISPLAY_RENDERER_RESET_US is a restarted source with a different clock,
+ * as in the receiver, and starts the ordering over. */
+void display_renderer_show(display_renderer_t* disp, jpeg_image_t* image) {
+    if (!disp || !image) return;
+    
+    display_path_stats_t* path = image->format == JPEG_DECODE_YUV ? &disp->stats.yuv : &disp->stats.rgb;
+    jpeg_image_t* replaced = NULL;
+    
+    pthread_mutex_lock(&disp->lock);
+    path->frames++;
+    path->decode_us += image->decode_us;
+    
+    if (image->timestamp_us < disp->newest_ts &&
+        disp->newest_ts - image->timestamp_us < DISPLAY_RENDERER_RESET_US) {
+        disp->stats.skipped++;
+        pthread_mutex_unlock(&disp->lock);
+        return;
+    }
+    
+    jpeg_image_retain(image);
+    replaced = disp->pending;
+    disp->pending = image;
+    disp->newest_ts = image->timestamp_us;
+    if (replaced) disp->stats.skipped++;
+    pthread_mutex_unlock(&disp->lock);
+    
+    jpeg_image_release(replaced);
+}
+
+/* Textures follow the size of the decoded frames. If the IYUV texture
+ * cannot be recreated the decoders are asked for RGB from then on. */
+static int resize_textures(display_renderer_t* disp, uint32_t width, uint32_t height) {
+    bool yuv = disp->yuv_texture != NULL;
     
-    if (result < 0) return -1;
+    if (disp->yuv_texture) SDL_DestroyTexture(disp->yuv_texture);
+    SDL_DestroyTexture(disp->texture);
+    disp->yuv_texture = NULL;
+    disp->shown = NULL;
+    disp->frame_width = width;
+    disp->frame_height = height;
     
-    SDL_UpdateTexture(
-        disp->texture,
-        NULL,
-        disp->rgb_buffer,
-        disp->frame_width * 3
+    disp->texture = SDL_CreateTexture(
+        disp->renderer,
+        SDL_PIXELFORMAT_RGB24,
+        SDL_TEXTUREACCESS_STREAMING,
+        width, height
     );
+    if (yuv) disp->yuv_texture = create_yuv_texture(disp);
+    if (!disp->yuv_texture) {
+        atomic_store_explicit(&disp->decode_format, JPEG_DECODE_RGB, memory_order_relaxed);
+    }
+    
+    return disp->texture ? 0 : -1;
+}
+
+/* Returns 1 for a YUV image decoded before the fall back to RGB, which has
+ * no texture to go to and is skipped. */
+static int upload_image(display_renderer_t* disp, const jpeg_image_t* image) {
+    if (image->width != disp->frame_width || image->height != disp->frame_height) {
+        if (resize_textures(disp, image->width, image->height) < 0) return -1;
+    }
+    if (image->format == JPEG_DECODE_YUV && !disp->yuv_texture) return 1;
+    
+    uint64_t start = now_us();
+    
+    if (image->format == JPEG_DECODE_YUV && disp->yuv_texture) {
+        SDL_UpdateYUVTexture(
+            disp->yuv_texture,
+            NULL,
+            image->planes[0], image->strides[0],
+            image->planes[1], image->strides[1],
+            image->planes[2], image->strides[2]
+        );
+        disp->shown = disp->yuv_texture;
+    } else if (image->format == JPEG_DECODE_RGB) {
+        SDL_UpdateTexture(disp->texture, NULL, image->planes[0], image->strides[0]);
+        disp->shown = disp->texture;
+    } else {
+        return -1;
+    }
+    
+    display_path_stats_t* path = image->format == JPEG_DECODE_YUV ? &disp->stats.yuv : &disp->stats.rgb;
+    path->uploads++;
+    path->upload_us += now_us() - start;
+    return 0;
+}
+
+/* Runs on the SDL thread. Returns 1 after presenting a newly decoded frame
+ * and 0 when there was nothing new to show. */
+int display_renderer_present(display_renderer_t* disp, uint64_t* timestamp_us) {
+    if (!disp || !disp->open) return -1;
+    
+    pthread_mutex_lock(&disp->lock);
+    jpeg_image_t* image = disp->pending;
+    disp->pending = NULL;
+    pthread_mutex_unlock(&disp->lock);
+    
+    if (!image) return 0;
+    
+    int uploaded = upload_image(disp, image);
+    if (uploaded != 0) {
+        if (uploaded > 0) {
+            pthread_mutex_lock(&disp->lock);
+            disp->stats.skipped++;
+            pthread_mutex_unlock(&disp->lock);
+        }
+        jpeg_image_release(image);
+        return uploaded > 0 ? 0 : -1;
+    }
+    
+    jpeg_image_release(disp->front);
+    disp->front = image;
     
     SDL_RenderClear(disp->renderer);
-    SDL_RenderCopy(disp->renderer, disp->texture, NULL, NULL);
+    SDL_RenderCopy(disp->renderer, disp->shown, NULL, NULL);
     SDL_RenderPresent(disp->renderer);
     
-    return 0;
+    disp->stats.displayed++;
+    if (timestamp_us) *timestamp_us = image->timestamp_us;
+    return 1;
+}
+
+const display_renderer_stats_t* display_renderer_stats(const display_renderer_t* disp) {
+    return disp ? &disp->stats : NULL;
 }
 
 void display_renderer_destroy(display_renderer_t* disp) {
     if (!disp) return;
     
-    if (disp->rgb_buffer) tjFree(disp->rgb_buffer);
-    if (disp->tj_instance) tjDestroy(disp->tj_instance);
+    jpeg_image_release(disp->pending);
+    jpeg_image_release(disp->front);
+    pthread_mutex_destroy(&disp->lock);
+    
+    if (disp->yuv_texture) SDL_DestroyTexture(disp->yuv_texture);
     if (disp->texture) SDL_DestroyTexture(disp->texture);
     if (disp->renderer) SDL_DestroyRenderer(disp->renderer);
     if (disp->window) SDL_DestroyWindow(disp->window);
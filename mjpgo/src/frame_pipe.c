@@ -1,61 +1,160 @@
+#define _GNU_SOURCE
 #include "../include/frame_pipe.h"
 #include <endian.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-frame_pipe_t* frame_pipe_create(int fd, uint32_t chunk_size) {
+/* The fd is switched to non-blocking so a reader that falls behind costs a
+ * dropped frame instead of a stalled worker. For a pipe, pipe_size grows
+ * the kernel buffer (never shrinks it) so that whole frames fit. */
+frame_pipe_t* frame_pipe_create(int fd, uint32_t pipe_size) {
     if (fd < 0) return NULL;
     
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return NULL;
+    
     frame_pipe_t* pipe = calloc(1, sizeof(*pipe));
-    if (!pipe) return NULL;
+    if (!pipe) {
+        fcntl(fd, F_SETFL, flags);
+        return NULL;
+    }
     
     pipe->fd = fd;
-    pipe->chunk_size = chunk_size > 0 ? chunk_size : 4096;
+    pipe->fd_flags = flags;
+    
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    if (capacity > 0 && pipe_size > (uint32_t)capacity) {
+        int grown = fcntl(fd, F_SETPIPE_SZ, pipe_size);
+        if (grown > 0) capacity = grown;
+    }
+    pipe->capacity = capacity > 0 ? (uint32_t)capacity : 0;
+    
+    long page = sysconf(_SC_PAGESIZE);
+    pipe->page_size = page > 0 ? (uint32_t)page : 4096;
+    atomic_init(&pipe->closing, false);
     
     return pipe;
 }
 
-static int write_all(int fd, const void* buf, size_t len) {
-    const uint8_t* ptr = buf;
-    size_t remaining = len;
+static size_t pages_for(const frame_pipe_t* pipe, size_t bytes) {
+    return (bytes + pipe->page_size - 1) / pipe->page_size;
+}
+
+/* A frame is only started when the pipe probably has room for all of it,
+ * so a reader that keeps up sees whole frames without the writer waiting.
+ * The pipe buffer is a ring of pages and FIONREAD counts bytes: a write
+ * fills fresh pages and only its tail shares a page with the one before,
+ * so each queued frame, taken as the size of this one, may waste a page. */
+static bool has_room(const frame_pipe_t* pipe, size_t total) {
+    if (pipe->capacity == 0) return true;
     
-    while (remaining > 0) {
-        ssize_t written = write(fd, ptr, remaining);
-        if (written < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        ptr += written;
-        remaining -= written;
-    }
+    int queued = 0;
+    if (ioctl(pipe->fd, FIONREAD, &queued) < 0) return true;
+    if (queued == 0) return true;
     
-    return 0;
+    size_t used = pages_for(pipe, queued) + (size_t)queued / total + 1;
+    return used + pages_for(pipe, total) + 1 <= pipe->capacity / pipe->page_size;
+}
+
+/* Waits for the reader to make room in the middle of a frame, for up to
+ * FRAME_PIPE_STALL_MS without progress, or FRAME_PIPE_POLL_MS once the
+ * output is closing. */
+static int wait_writable(frame_pipe_t* pipe, uint32_t* idle_ms) {
+    for (;;) {
+        uint32_t limit = atomic_load(&pipe->closing) ? FRAME_PIPE_POLL_MS : FRAME_PIPE_STALL_MS;
+        if (*idle_ms >= limit) return -1;
+        
+        struct pollfd pfd = { .fd = pipe->fd, .events = POLLOUT };
+        int ready = poll(&pfd, 1, FRAME_PIPE_POLL_MS);
+        if (ready < 0 && errno != EINTR) return -1;
+        if (ready > 0) return 0;
+        *idle_ms += FRAME_PIPE_POLL_MS;
+    }
 }
 
 int frame_pipe_write(frame_pipe_t* pipe, uint64_t timestamp_us,
                      const void* data, size_t data_len) {
-    if (!pipe || !data || data_len == 0) return -1;
+    if (!pipe || !data || data_len == 0 || pipe->broken) return -1;
     
-    uint64_t ts_be = htobe64(timestamp_us);
-    if (write_all(pipe->fd, &ts_be, sizeof(ts_be)) < 0) return -1;
+    size_t total = FRAME_PIPE_HEADER_SIZE + data_len;
+    if (pipe->capacity > 0 && pages_for(pipe, total) + 1 > pipe->capacity / pipe->page_size) {
+        pipe->stats.oversize++;
+        return 1;
+    }
+    if (!has_room(pipe, total)) {
+        pipe->stats.dropped++;
+        return 1;
+    }
     
+    uint8_t header[FRAME_PIPE_HEADER_SIZE];
+    uint64_t ts_be = htobe64(timestamp_us);
     uint32_t len_be = htobe32((uint32_t)data_len);
-    if (write_all(pipe->fd, &len_be, sizeof(len_be)) < 0) return -1;
+    memcpy(header, &ts_be, sizeof(ts_be));
+    memcpy(header + sizeof(ts_be), &len_be, sizeof(len_be));
     
-    const uint8_t* src = data;
-    size_t remaining = data_len;
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = (void*)data, .iov_len = data_len },
+    };
+    struct iovec* next = iov;
+    int count = 2;
+    size_t written = 0;
+    uint32_t idle_ms = 0;
     
-    while (remaining > 0) {
-        size_t chunk = remaining < pipe->chunk_size ? remaining : pipe->chunk_size;
-        if (write_all(pipe->fd, src, chunk) < 0) return -1;
-        src += chunk;
-        remaining -= chunk;
+    while (written < total) {
+        ssize_t n = writev(pipe->fd, next, count);
+        pipe->stats.writes++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && written == 0) {
+                pipe->stats.dropped++;
+                return 1;
+            }
+            
+            /* A frame cut short cannot be resynchronised by the reader, so
+             * a reader stalled for too long ends the output. */
+            if (errno != EAGAIN || wait_writable(pipe, &idle_ms) < 0) {
+                pipe->broken = true;
+                return -1;
+            }
+            pipe->stats.stalls++;
+            continue;
+        }
+        
+        written += n;
+        idle_ms = 0;
+        while (count > 0 && (size_t)n >= next->iov_len) {
+            n -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (uint8_t*)next->iov_base + n;
+            next->iov_len -= n;
+        }
     }
     
+    pipe->stats.frames++;
+    pipe->stats.bytes += total;
     return 0;
 }
 
+/* Called from another thread to end any wait in frame_pipe_write. */
+void frame_pipe_close(frame_pipe_t* pipe) {
+    if (!pipe) return;
+    atomic_store(&pipe->closing, true);
+}
+
 void frame_pipe_destroy(frame_pipe_t* pipe) {
+    if (!pipe) return;
+    
+    fcntl(pipe->fd, F_SETFL, pipe->fd_flags);
     free(pipe);
 }
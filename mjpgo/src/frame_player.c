@@ -0,0 +1,248 @@
+#include "../include/frame_player.h"
+#include "../include/frame_recorder.h"
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct frame_player {
+    AVFormatContext* fmt_ctx;
+    AVIOContext* io;
+    AVPacket* pkt;
+    int stream_index;
+    AVRational time_base;
+    int fd;
+    uint64_t skip_until_us;
+    frame_player_info_t info;
+};
+
+/* The demuxer asks for small pieces; reading through a large AVIO buffer
+ * turns that into few big sequential reads. */
+static int read_file(void* opaque, uint8_t* buf, int size) {
+    frame_player_t* player = opaque;
+    
+    for (;;) {
+        ssize_t got = read(player->fd, buf, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return AVERROR(errno);
+        return got == 0 ? AVERROR_EOF : (int)got;
+    }
+}
+
+static int64_t seek_file(void* opaque, int64_t offset, int whence) {
+    frame_player_t* player = opaque;
+    
+    if (whence & AVSEEK_SIZE) {
+        struct stat st;
+        return fstat(player->fd, &st) < 0 ? AVERROR(errno) : st.st_size;
+    }
+    
+    off_t pos = lseek(player->fd, offset, whence & ~AVSEEK_FORCE);
+    return pos < 0 ? AVERROR(errno) : pos;
+}
+
+static int open_input(frame_player_t* player, const char* filename) {
+    player->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (player->fd < 0) return -1;
+    posix_fadvise(player->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    player->fmt_ctx = avformat_alloc_context();
+    if (!player->fmt_ctx) return -1;
+    
+    uint8_t* buffer = av_malloc(FRAME_PLAYER_READ_SIZE);
+    if (!buffer) return -1;
+    
+    player->io = avio_alloc_context(buffer, FRAME_PLAYER_READ_SIZE, 0, player, read_file, NULL, seek_file);
+    if (!player->io) {
+        av_free(buffer);
+        return -1;
+    }
+    player->fmt_ctx->pb = player->io;
+    player->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    
+    if (avformat_open_input(&player->fmt_ctx, filename, NULL, NULL) < 0) return -1;
+    if (avformat_find_stream_info(player->fmt_ctx, NULL) < 0) return -1;
+    
+    player->stream_index = av_find_best_stream(player->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (player->stream_index < 0) return -1;
+    
+    AVStream* stream = player->fmt_ctx->streams[player->stream_index];
+    if (stream->codecpar->codec_id != AV_CODEC_ID_MJPEG) return -1;
+    
+    AVRational rate = stream->avg_frame_rate.num ? stream->avg_frame_rate : stream->r_frame_rate;
+    if (rate.num <= 0 || rate.den <= 0) rate = (AVRational){30, 1};
+    
+    player->time_base = stream->time_base;
+    player->info.width = stream->codecpar->width;
+    player->info.height = stream->codecpar->height;
+    /* Like the capture arguments, FPS_NUM/FPS_DEN is the frame interval. */
+    player->info.fps_num = rate.den;
+    player->info.fps_den = rate.num;
+    return 0;
+}
+
+/* "dive-0001.mkv" is indexed by "dive-0001.idx". */
+static int index_path(const char* filename, char* path, size_t size) {
+    const char* dot = strrchr(filename, '.');
+    const char* slash = strrchr(filename, '/');
+    int stem = (dot && (!slash || dot > slash)) ? (int)(dot - filename) : (int)strlen(filename);
+    
+    int len = snprintf(path, size, "%.*s.idx", stem, filename);
+    return (len < 0 || (size_t)len >= size) ? -1 : 0;
+}
+
+static int open_index(const char* filename) {
+    char path[PATH_MAX];
+    if (index_path(filename, path, sizeof(path)) < 0) return -1;
+    
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    char magic[sizeof(FRAME_RECORDER_INDEX_MAGIC) - 1];
+    if (read(fd, magic, sizeof(magic)) != (ssize_t)sizeof(magic) ||
+        memcmp(magic, FRAME_RECORDER_INDEX_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Reads the capture time of the first frame of a recording from its index,
+ * without opening the recording itself. */
+int frame_player_index_start(const char* filename, uint64_t* start_us) {
+    if (!filename || !start_us) return -1;
+    
+    int fd = open_index(filename);
+    if (fd < 0) return -1;
+    
+    uint64_t entry[2];
+    ssize_t got = read(fd, entry, sizeof(entry));
+    close(fd);
+    if (got != (ssize_t)sizeof(entry)) return -1;
+    
+    *start_us = be64toh(entry[0]);
+    return 0;
+}
+
+/* Index entries point at clusters that start with a frame, so they become
+ * seek points for the demuxer, also in a segment that was never finalized
+ * and has no cues. Entry times are capture times; the first is pts 0. */
+static void load_index(frame_player_t* player, const char* filename) {
+    int fd = open_index(filename);
+    if (fd < 0) return;
+    
+    AVStream* stream = player->fmt_ctx->streams[player->stream_index];
+    uint64_t entries[256][2];
+    ssize_t got;
+    while ((got = read(fd, entries, sizeof(entries))) >= (ssize_t)sizeof(entries[0])) {
+        for (size_t i = 0; i < (size_t)got / sizeof(entries[0]); i++) {
+            uint64_t ts = be64toh(entries[i][0]);
+            uint64_t pos = be64toh(entries[i][1]);
+            if (player->info.index_entries == 0) player->info.start_us = ts;
+            if (ts < player->info.start_us) continue;
+            
+            int64_t pts = av_rescale_q(ts - player->info.start_us, (AVRational){1, 1000000}, player->time_base);
+            av_add_index_entry(stream, pos, pts, 0, 0, AVINDEX_KEYFRAME);
+            player->info.index_entries++;
+        }
+        if (got % sizeof(entries[0]) != 0) break;
+    }
+    close(fd);
+}
+
+/* A failed avformat_open_input frees the context but leaves the custom
+ * AVIO context to the caller. */
+static void close_input(frame_player_t* player) {
+    avformat_close_input(&player->fmt_ctx);
+    if (player->io) {
+        av_freep(&player->io->buffer);
+        avio_context_free(&player->io);
+    }
+    if (player->fd >= 0) close(player->fd);
+    player->fd = -1;
+}
+
+/* Plays the MJPEG track of a Matroska file such as one written by
+ * frame_recorder. */
+frame_player_t* frame_player_create(const char* filename) {
+    frame_player_t* player = calloc(1, sizeof(*player));
+    if (!player) return NULL;
+    
+    player->fd = -1;
+    player->pkt = av_packet_alloc();
+    if (!player->pkt || open_input(player, filename) < 0) {
+        close_input(player);
+        av_packet_free(&player->pkt);
+        free(player);
+        return NULL;
+    }
+    
+    load_index(player, filename);
+    return player;
+}
+
+const frame_player_info_t* frame_player_info(const frame_player_t* player) {
+    return player ? &player->info : NULL;
+}
+
+/* Returns 1 with the next frame, which stays valid until the next call,
+ * 0 at the end of the file and -1 on a read error. */
+int frame_player_read(frame_player_t* player, uint64_t* pts_us, const uint8_t** data, size_t* len) {
+    if (!player || !pts_us || !data || !len) return -1;
+    
+    for (;;) {
+        av_packet_unref(player->pkt);
+        
+        int ret = av_read_frame(player->fmt_ctx, player->pkt);
+        if (ret == AVERROR_EOF) return 0;
+        if (ret < 0) return -1;
+        if (player->pkt->stream_index != player->stream_index || player->pkt->size <= 0) continue;
+        
+        int64_t pts = player->pkt->pts != AV_NOPTS_VALUE ? player->pkt->pts : player->pkt->dts;
+        *pts_us = pts > 0 ? av_rescale_q(pts, player->time_base, (AVRational){1, 1000000}) : 0;
+        if (*pts_us < player->skip_until_us) continue;
+        
+        player->skip_until_us = 0;
+        *data = player->pkt->data;
+        *len = player->pkt->size;
+        return 1;
+    }
+}
+
+int frame_player_rewind(frame_player_t* player) {
+    if (!player) return -1;
+    
+    av_packet_unref(player->pkt);
+    player->skip_until_us = 0;
+    return av_seek_frame(player->fmt_ctx, player->stream_index, 0, AVSEEK_FLAG_BACKWARD) < 0 ? -1 : 0;
+}
+
+/* Jumps to the last seek point at or before offset_us from the first frame
+ * and skips ahead from there, so the next read returns the first frame at
+ * or after offset_us. */
+int frame_player_seek(frame_player_t* player, uint64_t offset_us) {
+    if (!player) return -1;
+    
+    av_packet_unref(player->pkt);
+    int64_t ts = av_rescale_q(offset_us, (AVRational){1, 1000000}, player->time_base);
+    if (av_seek_frame(player->fmt_ctx, player->stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) return -1;
+    
+    player->skip_until_us = offset_us;
+    return 0;
+}
+
+void frame_player_destroy(frame_player_t* player) {
+    if (!player) return;
+    
+    av_packet_unref(player->pkt);
+    av_packet_free(&player->pkt);
+    close_input(player);
+    free(player);
+}
@@ -1,109 +1,321 @@
 #include "../include/frame_recorder.h"
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* FFmpeg 7 made the AVIO write callback take a const buffer. */
+#if defined(FF_API_AVIO_WRITE_NONCONST) && !FF_API_AVIO_WRITE_NONCONST
+typedef const uint8_t avio_write_buf_t;
+#else
+typedef uint8_t avio_write_buf_t;
+#endif
 
 struct frame_recorder {
     AVFormatContext* fmt_ctx;
     AVStream* stream;
-    AVCodecContext* codec_ctx;
     AVPacket* pkt;
     uint64_t base_ts;
+    uint64_t last_ts;
     int base_ts_set;
     AVRational time_base;
+    uint32_t width;
+    uint32_t height;
+    int fd;
+    uint64_t sync_interval_us;
+    uint64_t last_sync_us;
+    char filename[PATH_MAX];
+    uint64_t segment_us;
+    uint64_t segment_bytes;
+    uint32_t segment_number;
+    uint64_t segment_written;
+    int index_fd;
+    uint64_t next_index_ts;
+    uint64_t retry_ts;
+    frame_recorder_stats_t stats;
 };
 
-frame_recorder_t* frame_recorder_create(const char* filename,
-                                         uint32_t width, uint32_t height,
-                                         uint32_t fps_num, uint32_t fps_den) {
-    frame_recorder_t* rec = calloc(1, sizeof(*rec));
-    if (!rec) return NULL;
-    
-    rec->time_base = (AVRational){fps_num, fps_den};
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const uint8_t* ptr = buf;
+    size_t remaining = len;
     
-    if (avformat_alloc_output_context2(&rec->fmt_ctx, NULL, "matroska", NULL) < 0) {
-        free(rec);
-        return NULL;
+    while (remaining > 0) {
+        ssize_t written = write(fd, ptr, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        ptr += written;
+        remaining -= written;
     }
     
-    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
-    if (!codec) {
-        avformat_free_context(rec->fmt_ctx);
-        free(rec);
-        return NULL;
+    return 0;
+}
+
+/* AVIO hands over its whole buffer at once, so the file sees few large
+ * writes instead of one per muxed element. */
+static int write_packet(void* opaque, avio_write_buf_t* buf, int size) {
+    frame_recorder_t* rec = opaque;
+    uint64_t start = now_us();
+    if (write_all(rec->fd, buf, size) < 0) return AVERROR(errno);
+    
+    uint64_t elapsed = now_us() - start;
+    rec->stats.bytes += size;
+    rec->stats.writes++;
+    rec->stats.write_us += elapsed;
+    if (elapsed > rec->stats.write_max_us) rec->stats.write_max_us = elapsed;
+    return size;
+}
+
+static int64_t seek_file(void* opaque, int64_t offset, int whence) {
+    frame_recorder_t* rec = opaque;
+    
+    if (whence & AVSEEK_SIZE) {
+        struct stat st;
+        return fstat(rec->fd, &st) < 0 ? AVERROR(errno) : st.st_size;
     }
     
-    rec->stream = avformat_new_stream(rec->fmt_ctx, codec);
-    if (!rec->stream) {
-        avformat_free_context(rec->fmt_ctx);
-        free(rec);
-        return NULL;
+    off_t pos = lseek(rec->fd, offset, whence & ~AVSEEK_FORCE);
+    return pos < 0 ? AVERROR(errno) : pos;
+}
+
+/* Segment n of "dive.mkv" is "dive-000n.mkv" with its index in
+ * "dive-000n.idx". */
+int frame_recorder_segment_path(const char* filename, uint32_t number, const char* ext,
+                                char* path, size_t size) {
+    if (!filename || !ext || !path) return -1;
+    
+    const char* dot = strrchr(filename, '.');
+    const char* slash = strrchr(filename, '/');
+    int stem = (dot && (!slash || dot > slash)) ? (int)(dot - filename) : (int)strlen(filename);
+    
+    int len = snprintf(path, size, "%.*s-%04u%s", stem, filename, number, ext);
+    return (len < 0 || (size_t)len >= size) ? -1 : 0;
+}
+
+/* The index starts with FRAME_RECORDER_INDEX_MAGIC followed by big-endian
+ * pairs of capture timestamp and byte offset of the cluster that starts
+ * with that frame. A torn last pair is simply ignored by readers. */
+static int open_index(frame_recorder_t* rec, uint32_t number) {
+    char path[PATH_MAX];
+    if (frame_recorder_segment_path(rec->filename, number, ".idx", path, sizeof(path)) < 0) return -1;
+    
+    rec->index_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->index_fd < 0) return -1;
+    return write_all(rec->index_fd, FRAME_RECORDER_INDEX_MAGIC, strlen(FRAME_RECORDER_INDEX_MAGIC));
+}
+
+static void write_index(frame_recorder_t* rec, uint64_t timestamp_us) {
+    av_write_frame(rec->fmt_ctx, NULL);
+    
+    uint64_t entry[2] = { htobe64(timestamp_us), htobe64(avio_tell(rec->fmt_ctx->pb)) };
+    write_all(rec->index_fd, entry, sizeof(entry));
+    rec->next_index_ts = timestamp_us + (uint64_t)FRAME_RECORDER_INDEX_INTERVAL_MS * 1000;
+}
+
+/* The segment number only advances once the segment file is open, so a
+ * failing disk keeps retrying the same pair of names. */
+static int open_output(frame_recorder_t* rec) {
+    bool segmented = rec->segment_us || rec->segment_bytes;
+    uint32_t number = rec->segment_number + 1;
+    const char* path = rec->filename;
+    char segment[PATH_MAX];
+    if (segmented) {
+        if (frame_recorder_segment_path(rec->filename, number, ".mkv", segment, sizeof(segment)) < 0) return -1;
+        path = segment;
     }
     
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->fd < 0) return -1;
+    if (segmented && open_index(rec, number) < 0) return -1;
+    
+    if (avformat_alloc_output_context2(&rec->fmt_ctx, NULL, "matroska", NULL) < 0) return -1;
+    
+    rec->stream = avformat_new_stream(rec->fmt_ctx, NULL);
+    if (!rec->stream) return -1;
+    
     rec->stream->codecpar->codec_id = AV_CODEC_ID_MJPEG;
     rec->stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
     rec->stream->codecpar->format = AV_PIX_FMT_YUVJ420P;
-    rec->stream->codecpar->width = width;
-    rec->stream->codecpar->height = height;
+    rec->stream->codecpar->width = rec->width;
+    rec->stream->codecpar->height = rec->height;
     rec->stream->time_base = rec->time_base;
     
-    rec->codec_ctx = avcodec_alloc_context3(codec);
-    if (!rec->codec_ctx) {
-        avformat_free_context(rec->fmt_ctx);
-        free(rec);
-        return NULL;
+    uint8_t* buffer = av_malloc(FRAME_RECORDER_BUFFER_SIZE);
+    if (!buffer) return -1;
+    
+    rec->fmt_ctx->pb = avio_alloc_context(buffer, FRAME_RECORDER_BUFFER_SIZE, 1, rec,
+                                          NULL, write_packet, seek_file);
+    if (!rec->fmt_ctx->pb) {
+        av_free(buffer);
+        return -1;
     }
     
-    rec->codec_ctx->time_base = rec->time_base;
-    avcodec_parameters_to_context(rec->codec_ctx, rec->stream->codecpar);
+    rec->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    rec->fmt_ctx->flush_packets = 0;
+    if (avformat_write_header(rec->fmt_ctx, NULL) < 0) return -1;
+    
+    rec->base_ts_set = 0;
+    rec->segment_written = 0;
+    rec->segment_number = number;
+    rec->stats.segments++;
+    return 0;
+}
+
+static void close_output(frame_recorder_t* rec, bool finish) {
+    if (finish) {
+        av_write_trailer(rec->fmt_ctx);
+        avio_flush(rec->fmt_ctx->pb);
+        fdatasync(rec->fd);
+        if (rec->index_fd >= 0) fdatasync(rec->index_fd);
+    }
     
-    if (avcodec_open2(rec->codec_ctx, codec, NULL) < 0) {
-        avcodec_free_context(&rec->codec_ctx);
+    if (rec->fmt_ctx) {
+        if (rec->fmt_ctx->pb) {
+            av_freep(&rec->fmt_ctx->pb->buffer);
+            avio_context_free(&rec->fmt_ctx->pb);
+        }
         avformat_free_context(rec->fmt_ctx);
-        free(rec);
-        return NULL;
+        rec->fmt_ctx = NULL;
     }
     
+    if (rec->fd >= 0) close(rec->fd);
+    if (rec->index_fd >= 0) close(rec->index_fd);
+    rec->fd = -1;
+    rec->index_fd = -1;
+}
+
+/* Ends the current cluster and pushes everything written so far to the
+ * storage device, bounding what a power cut can lose to one interval. */
+static void sync_output(frame_recorder_t* rec) {
+    uint64_t start = now_us();
+    av_write_frame(rec->fmt_ctx, NULL);
+    avio_flush(rec->fmt_ctx->pb);
+    fdatasync(rec->fd);
+    if (rec->index_fd >= 0) fdatasync(rec->index_fd);
+    
+    uint64_t end = now_us();
+    rec->last_sync_us = end;
+    rec->stats.syncs++;
+    rec->stats.sync_us += end - start;
+    if (end - start > rec->stats.sync_max_us) rec->stats.sync_max_us = end - start;
+}
+
+frame_recorder_t* frame_recorder_create(const char* filename,
+                                         uint32_t width, uint32_t height,
+                                         uint32_t fps_num, uint32_t fps_den) {
+    return frame_recorder_create_segmented(filename, width, height, fps_num, fps_den, 0, 0);
+}
+
+/* With a segment length or size set, the recording is split into
+ * self-contained files that each get their own timestamp index, so losing
+ * power costs at most the tail of the last segment. */
+frame_recorder_t* frame_recorder_create_segmented(const char* filename,
+                                                   uint32_t width, uint32_t height,
+                                                   uint32_t fps_num, uint32_t fps_den,
+                                                   uint32_t segment_seconds, uint64_t segment_bytes) {
+    if (!filename || strlen(filename) >= PATH_MAX) return NULL;
+    
+    frame_recorder_t* rec = calloc(1, sizeof(*rec));
+    if (!rec) return NULL;
+    
+    rec->fd = -1;
+    rec->index_fd = -1;
+    rec->time_base = (AVRational){fps_num, fps_den};
+    rec->width = width;
+    rec->height = height;
+    rec->sync_interval_us = (uint64_t)FRAME_RECORDER_SYNC_DEFAULT_MS * 1000;
+    rec->segment_us = (uint64_t)segment_seconds * 1000000;
+    rec->segment_bytes = segment_bytes;
+    strcpy(rec->filename, filename);
+    
     rec->pkt = av_packet_alloc();
     if (!rec->pkt) {
-        avcodec_free_context(&rec->codec_ctx);
-        avformat_free_context(rec->fmt_ctx);
         free(rec);
         return NULL;
     }
     
-    if (!(rec->fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&rec->fmt_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) {
-            av_packet_free(&rec->pkt);
-            avcodec_free_context(&rec->codec_ctx);
-            avformat_free_context(rec->fmt_ctx);
-            free(rec);
-            return NULL;
-        }
-    }
-    
-    if (avformat_write_header(rec->fmt_ctx, NULL) < 0) {
-        avio_closep(&rec->fmt_ctx->pb);
+    if (open_output(rec) < 0) {
+        close_output(rec, false);
         av_packet_free(&rec->pkt);
-        avcodec_free_context(&rec->codec_ctx);
-        avformat_free_context(rec->fmt_ctx);
         free(rec);
         return NULL;
     }
     
+    rec->last_sync_us = now_us();
     return rec;
 }
 
+/* 0 leaves flushing to the buffer filling up and syncs only on close. */
+void frame_recorder_set_sync(frame_recorder_t* rec, uint32_t interval_ms) {
+    if (!rec) return;
+    rec->sync_interval_us = (uint64_t)interval_ms * 1000;
+}
+
+static bool segment_full(const frame_recorder_t* rec, uint64_t timestamp_us) {
+    if (!rec->base_ts_set) return false;
+    if (rec->segment_us && timestamp_us - rec->base_ts >= rec->segment_us) return true;
+    return rec->segment_bytes && rec->segment_written >= rec->segment_bytes;
+}
+
 int frame_recorder_write(frame_recorder_t* rec, uint64_t timestamp_us,
                          const void* jpeg_data, size_t jpeg_len) {
     if (!rec || !jpeg_data || jpeg_len == 0) return -1;
     
+    /* Times relative to the segment start must not run backwards: a
+     * segmented recording starts a new segment, a single file carries on
+     * one frame interval after the last frame. */
+    bool segmented = rec->segment_us || rec->segment_bytes;
+    if (rec->fmt_ctx && rec->base_ts_set && timestamp_us < rec->last_ts) {
+        if (segmented) {
+            close_output(rec, true);
+        } else {
+            uint64_t interval_us = av_rescale_q(1, rec->time_base, (AVRational){1, 1000000});
+            rec->base_ts = timestamp_us - (rec->last_ts - rec->base_ts) - interval_us;
+        }
+    }
+    
+    if (rec->fmt_ctx && segment_full(rec, timestamp_us)) close_output(rec, true);
+    
+    /* After a failed open, frames are dropped until the next segment would
+     * have started, or for FRAME_RECORDER_RETRY_MS, before trying again. A
+     * source clock that jumps back past the failure retries at once. */
+    uint64_t hold_us = rec->segment_us ? rec->segment_us : (uint64_t)FRAME_RECORDER_RETRY_MS * 1000;
+    if (!rec->fmt_ctx && rec->retry_ts > timestamp_us && rec->retry_ts - timestamp_us <= hold_us) {
+        rec->stats.failed++;
+        return -1;
+    }
+    if (!rec->fmt_ctx && open_output(rec) < 0) {
+        close_output(rec, false);
+        rec->retry_ts = timestamp_us + hold_us;
+        rec->stats.failed++;
+        return -1;
+    }
+    
     if (!rec->base_ts_set) {
         rec->base_ts = timestamp_us;
         rec->base_ts_set = 1;
+        rec->next_index_ts = timestamp_us;
     }
     
+    if (rec->index_fd >= 0 && timestamp_us >= rec->next_index_ts) write_index(rec, timestamp_us);
+    rec->last_ts = timestamp_us;
+    
     uint64_t rel_ts = timestamp_us - rec->base_ts;
     
     rec->pkt->data = (uint8_t*)jpeg_data;
@@ -116,27 +328,29 @@ int frame_recorder_write(frame_recorder_t* rec, uint64_t timestamp_us,
     int ret = av_interleaved_write_frame(rec->fmt_ctx, rec->pkt);
     av_packet_unref(rec->pkt);
     
-    return (ret >= 0) ? 0 : -1;
+    if (ret < 0) {
+        rec->stats.failed++;
+        return -1;
+    }
+    rec->stats.frames++;
+    rec->segment_written += jpeg_len;
+    
+    if (rec->sync_interval_us && now_us() - rec->last_sync_us >= rec->sync_interval_us) {
+        sync_output(rec);
+    }
+    return 0;
+}
+
+const frame_recorder_stats_t* frame_recorder_stats(const frame_recorder_t* rec) {
+    return rec ? &rec->stats : NULL;
 }
 
 void frame_recorder_destroy(frame_recorder_t* rec) {
     if (!rec) return;
     
-    av_write_trailer(rec->fmt_ctx);
-    
-    if (rec->codec_ctx) {
-        avcodec_close(rec->codec_ctx);
-        avcodec_free_context(&rec->codec_ctx);
-    }
+    if (rec->fmt_ctx) close_output(rec, true);
     
     if (rec->pkt) av_packet_free(&rec->pkt);
     
-    if (rec->fmt_ctx) {
-        if (!(rec->fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&rec->fmt_ctx->pb);
-        }
-        avformat_free_context(rec->fmt_ctx);
-    }
-    
     free(rec);
 }
@@ -0,0 +1,441 @@
+#include "../include/frame_ring.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct frame_ring {
+    pthread_mutex_t lock;
+    frame_ref_t* slots;
+    frame_ref_t** free_slots;
+    uint32_t slot_count;
+    uint32_t free_count;
+    frame_recycle_fn recycle;
+    void* recycle_ctx;
+};
+
+struct frame_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    frame_ref_t** entries;
+    uint32_t depth;
+    uint32_t base_depth;
+    uint32_t head;
+    uint32_t count;
+    int policy;
+    bool closed;
+    uint64_t dropped;
+    size_t spill_limit;
+    size_t spill_bytes;
+    size_t spill_peak;
+    uint64_t spilled;
+};
+
+static frame_ring_t* alloc_ring(uint32_t slot_count) {
+    frame_ring_t* ring = calloc(1, sizeof(*ring));
+    if (!ring) return NULL;
+    
+    ring->slots = calloc(slot_count, sizeof(frame_ref_t));
+    ring->free_slots = calloc(slot_count, sizeof(frame_ref_t*));
+    if (!ring->slots || !ring->free_slots) {
+        free(ring->free_slots);
+        free(ring->slots);
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+frame_ring_t* frame_ring_create(uint32_t slot_count, size_t slot_size) {
+    if (slot_count == 0 || slot_size == 0) return NULL;
+    
+    frame_ring_t* ring = alloc_ring(slot_count);
+    if (!ring) return NULL;
+    
+    for (uint32_t i = 0; i < slot_count; i++) {
+        frame_ref_t* slot = &ring->slots[i];
+        slot->ring = ring;
+        slot->capacity = slot_size;
+        slot->data = malloc(slot_size);
+        if (!slot->data) goto fail;
+        atomic_init(&slot->refs, 0);
+        ring->free_slots[i] = slot;
+        ring->slot_count++;
+    }
+    ring->free_count = slot_count;
+    
+    pthread_mutex_init(&ring->lock, NULL);
+    return ring;
+
+fail:
+    for (uint32_t i = 0; i < ring->slot_count; i++) free(ring->slots[i].data);
+    free(ring->free_slots);
+    free(ring->slots);
+    free(ring);
+    return NULL;
+}
+
+/* Slots of a borrowed ring own no memory: the caller points data at a buffer
+ * it lends out, and recycle is called once the last reference is dropped so
+ * the buffer can be handed back to its owner. */
+frame_ring_t* frame_ring_create_borrowed(uint32_t slot_count, frame_recycle_fn recycle, void* ctx) {
+    if (slot_count == 0 || !recycle) return NULL;
+    
+    frame_ring_t* ring = alloc_ring(slot_count);
+    if (!ring) return NULL;
+    
+    for (uint32_t i = 0; i < slot_count; i++) {
+        frame_ref_t* slot = &ring->slots[i];
+        slot->ring = ring;
+        atomic_init(&slot->refs, 0);
+        ring->free_slots[i] = slot;
+    }
+    ring->slot_count = slot_count;
+    ring->free_count = slot_count;
+    ring->recycle = recycle;
+    ring->recycle_ctx = ctx;
+    
+    pthread_mutex_init(&ring->lock, NULL);
+    return ring;
+}
+
+frame_ref_t* frame_ring_acquire(frame_ring_t* ring) {
+    if (!ring) return NULL;
+    
+    pthread_mutex_lock(&ring->lock);
+    frame_ref_t* slot = NULL;
+    if (ring->free_count > 0) {
+        slot = ring->free_slots[--ring->free_count];
+    }
+    pthread_mutex_unlock(&ring->lock);
+    
+    if (!slot) return NULL;
+    
+    atomic_store_explicit(&slot->refs, 1, memory_order_relaxed);
+    slot->len = 0;
+    slot->timestamp_us = 0;
+    memset(slot->stage_us, 0, sizeof(slot->stage_us));
+    slot->opaque = NULL;
+    return slot;
+}
+
+/* Grows an acquired slot of an owning ring to hold size bytes. The slot is
+ * held only by the caller, so its buffer can be replaced; it keeps the new
+ * size when it goes back to the ring. */
+int frame_ref_reserve(frame_ref_t* frame, size_t size) {
+    if (!frame) return -1;
+    if (size <= frame->capacity) return 0;
+    if (frame->ring->recycle) return -1;
+    
+    uint8_t* data = realloc(frame->data, size);
+    if (!data) return -1;
+    
+    frame->data = data;
+    frame->capacity = size;
+    return 0;
+}
+
+void frame_ref_retain(frame_ref_t* frame) {
+    if (!frame) return;
+    atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+}
+
+void frame_ref_release(frame_ref_t* frame) {
+    if (!frame) return;
+    if (atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) != 1) return;
+    
+    frame_ring_t* ring = frame->ring;
+    if (!ring) {
+        free(frame->data);
+        free(frame);
+        return;
+    }
+    if (ring->recycle) ring->recycle(ring->recycle_ctx, frame);
+    
+    pthread_mutex_lock(&ring->lock);
+    ring->free_slots[ring->free_count++] = frame;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void frame_ring_destroy(frame_ring_t* ring) {
+    if (!ring) return;
+    
+    if (!ring->recycle) {
+        for (uint32_t i = 0; i < ring->slot_count; i++) {
+            free(ring->slots[i].data);
+        }
+    }
+    
+    pthread_mutex_destroy(&ring->lock);
+    free(ring->free_slots);
+    free(ring->slots);
+    free(ring);
+}
+
+frame_queue_t* frame_queue_create(uint32_t depth, int policy) {
+    if (depth == 0) return NULL;
+    if (policy != FRAME_POLICY_LATEST && policy != FRAME_POLICY_QUEUE && policy != FRAME_POLICY_SPILL) return NULL;
+    
+    frame_queue_t* queue = calloc(1, sizeof(*queue));
+    if (!queue) return NULL;
+    
+    queue->entries = calloc(depth, sizeof(frame_ref_t*));
+    if (!queue->entries) {
+        free(queue);
+        return NULL;
+    }
+    
+    queue->depth = depth;
+    queue->base_depth = depth;
+    queue->policy = policy;
+    
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->ready, &attr);
+    pthread_cond_init(&queue->space, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&queue->lock, NULL);
+    
+    return queue;
+}
+
+/* Spill queues hold at most base_depth frames by reference, so a slow
+ * consumer never pins more ring slots than a plain queue would; later
+ * frames are copied to the heap, up to spill_limit bytes. */
+int frame_queue_set_spill(frame_queue_t* queue, size_t max_bytes) {
+    if (!queue || queue->policy != FRAME_POLICY_SPILL) return -1;
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->spill_limit = max_bytes;
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+static frame_ref_t* spill_copy(const frame_ref_t* frame) {
+    frame_ref_t* copy = calloc(1, sizeof(*copy));
+    if (!copy) return NULL;
+    
+    copy->data = malloc(frame->len ? frame->len : 1);
+    if (!copy->data) {
+        free(copy);
+        return NULL;
+    }
+    
+    memcpy(copy->data, frame->data, frame->len);
+    atomic_init(&copy->refs, 1);
+    copy->capacity = frame->len;
+    copy->len = frame->len;
+    copy->timestamp_us = frame->timestamp_us;
+    memcpy(copy->stage_us, frame->stage_us, sizeof(copy->stage_us));
+    return copy;
+}
+
+/* Doubles the entry array, keeping the queued frames in order. */
+static int grow_entries(frame_queue_t* queue) {
+    frame_ref_t** entries = calloc((size_t)queue->depth * 2, sizeof(frame_ref_t*));
+    if (!entries) return -1;
+    
+    for (uint32_t i = 0; i < queue->count; i++) {
+        entries[i] = queue->entries[(queue->head + i) % queue->depth];
+    }
+    free(queue->entries);
+    queue->entries = entries;
+    queue->depth *= 2;
+    queue->head = 0;
+    return 0;
+}
+
+/* The copy is made outside the lock so the consumer is not held up by it;
+ * the caller is the only producer, so the queue cannot fill meanwhile. */
+static int push_spilled(frame_queue_t* queue, frame_ref_t* frame) {
+    if (queue->spill_bytes + frame->len > queue->spill_limit) {
+        queue->dropped++;
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->spill_bytes += frame->len;
+    pthread_mutex_unlock(&queue->lock);
+    
+    frame_ref_t* copy = spill_copy(frame);
+    
+    pthread_mutex_lock(&queue->lock);
+    if (!copy || queue->closed || (queue->count == queue->depth && grow_entries(queue) < 0)) {
+        queue->spill_bytes -= frame->len;
+        queue->dropped++;
+        pthread_mutex_unlock(&queue->lock);
+        frame_ref_release(copy);
+        return -1;
+    }
+    
+    if (queue->spill_bytes > queue->spill_peak) queue->spill_peak = queue->spill_bytes;
+    queue->spilled++;
+    queue->entries[(queue->head + queue->count) % queue->depth] = copy;
+    queue->count++;
+    
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+int frame_queue_push(frame_queue_t* queue, frame_ref_t* frame) {
+    if (!queue || !frame) return -1;
+    
+    frame_ref_t* evicted = NULL;
+    
+    pthread_mutex_lock(&queue->lock);
+    
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    
+    if (queue->policy == FRAME_POLICY_SPILL && queue->count >= queue->base_depth) {
+        return push_spilled(queue, frame);
+    }
+    
+    if (queue->count == queue->depth) {
+        queue->dropped++;
+        
+        if (queue->policy != FRAME_POLICY_LATEST) {
+            pthread_mutex_unlock(&queue->lock);
+            return -1;
+        }
+        
+        evicted = queue->entries[queue->head];
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->count--;
+    }
+    
+    frame_ref_retain(frame);
+    queue->entries[(queue->head + queue->count) % queue->depth] = frame;
+    queue->count++;
+    
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+    
+    frame_ref_release(evicted);
+    return 0;
+}
+
+static void deadline_after(struct timespec* deadline, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Waits up to timeout_ms for room instead of applying the queue's policy,
+ * for inputs that can slow down to the outputs. Returns 0 once queued, 1
+ * if the queue is still full and -1 once it is closed. */
+int frame_queue_push_wait(frame_queue_t* queue, frame_ref_t* frame, int timeout_ms) {
+    if (!queue || !frame) return -1;
+    
+    struct timespec deadline;
+    deadline_after(&deadline, timeout_ms);
+    
+    pthread_mutex_lock(&queue->lock);
+    
+    while (queue->count >= queue->base_depth && !queue->closed) {
+        if (pthread_cond_timedwait(&queue->space, &queue->lock, &deadline) == ETIMEDOUT) break;
+    }
+    
+    int result = queue->closed ? -1 : queue->count >= queue->base_depth ? 1 : 0;
+    if (result == 0) {
+        frame_ref_retain(frame);
+        queue->entries[(queue->head + queue->count) % queue->depth] = frame;
+        queue->count++;
+        pthread_cond_signal(&queue->ready);
+    }
+    
+    pthread_mutex_unlock(&queue->lock);
+    return result;
+}
+
+frame_ref_t* frame_queue_pop(frame_queue_t* queue, int timeout_ms) {
+    if (!queue) return NULL;
+    
+    struct timespec deadline;
+    if (timeout_ms >= 0) deadline_after(&deadline, timeout_ms);
+    
+    pthread_mutex_lock(&queue->lock);
+    
+    while (queue->count == 0 && !queue->closed) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&queue->ready, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->ready, &queue->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    
+    frame_ref_t* frame = NULL;
+    if (queue->count > 0) {
+        frame = queue->entries[queue->head];
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->count--;
+        if (!frame->ring) queue->spill_bytes -= frame->len;
+        pthread_cond_signal(&queue->space);
+    }
+    
+    pthread_mutex_unlock(&queue->lock);
+    return frame;
+}
+
+void frame_queue_close(frame_queue_t* queue) {
+    if (!queue) return;
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->ready);
+    pthread_cond_broadcast(&queue->space);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+uint64_t frame_queue_dropped(frame_queue_t* queue) {
+    if (!queue) return 0;
+    
+    pthread_mutex_lock(&queue->lock);
+    uint64_t dropped = queue->dropped;
+    pthread_mutex_unlock(&queue->lock);
+    return dropped;
+}
+
+uint64_t frame_queue_spilled(frame_queue_t* queue) {
+    if (!queue) return 0;
+    
+    pthread_mutex_lock(&queue->lock);
+    uint64_t spilled = queue->spilled;
+    pthread_mutex_unlock(&queue->lock);
+    return spilled;
+}
+
+size_t frame_queue_spill_peak(frame_queue_t* queue) {
+    if (!queue) return 0;
+    
+    pthread_mutex_lock(&queue->lock);
+    size_t peak = queue->spill_peak;
+    pthread_mutex_unlock(&queue->lock);
+    return peak;
+}
+
+void frame_queue_destroy(frame_queue_t* queue) {
+    if (!queue) return;
+    
+    while (queue->count > 0) {
+        frame_ref_release(queue->entries[queue->head]);
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->count--;
+    }
+    
+    pthread_cond_destroy(&queue->ready);
+    pthread_cond_destroy(&queue->space);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->entries);
+    free(queue);
+}
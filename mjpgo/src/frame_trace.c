@@ -0,0 +1,92 @@
+#include "../include/frame_trace.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+struct frame_trace {
+    FILE* file;
+    pthread_mutex_t lock;
+    bool first;
+};
+
+static void begin_event(frame_trace_t* trace) {
+    fputs(trace->first ? "\n" : ",\n", trace->file);
+    trace->first = false;
+}
+
+/* Track names come from device paths, addresses and file names, so quotes,
+ * backslashes and control characters are escaped. */
+static void put_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', file);
+            fputc(*p, file);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/* Chrome trace JSON array format: one complete ("X") event per stage, with
+ * the frame timestamp as an argument so stages of one frame can be matched
+ * up, also across the sender and receiver trace files. */
+frame_trace_t* frame_trace_create(const char* filename) {
+    if (!filename) return NULL;
+    
+    frame_trace_t* trace = calloc(1, sizeof(*trace));
+    if (!trace) return NULL;
+    
+    trace->file = fopen(filename, "w");
+    if (!trace->file) {
+        free(trace);
+        return NULL;
+    }
+    
+    setvbuf(trace->file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    fputs("[", trace->file);
+    trace->first = true;
+    pthread_mutex_init(&trace->lock, NULL);
+    return trace;
+}
+
+void frame_trace_name_track(frame_trace_t* trace, uint32_t track, const char* name) {
+    if (!trace || !name) return;
+    
+    pthread_mutex_lock(&trace->lock);
+    begin_event(trace);
+    fprintf(trace->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", track);
+    put_string(trace->file, name);
+    fputs("}}", trace->file);
+    pthread_mutex_unlock(&trace->lock);
+}
+
+void frame_trace_span(frame_trace_t* trace, uint32_t track, const char* name,
+                      uint64_t frame_ts, uint64_t start_us, uint64_t end_us) {
+    if (!trace || start_us == 0 || end_us < start_us) return;
+    
+    pthread_mutex_lock(&trace->lock);
+    begin_event(trace);
+    fputs("{\"name\":", trace->file);
+    put_string(trace->file, name);
+    fprintf(trace->file,
+            ",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+            "\"ts\":%lu,\"dur\":%lu,\"args\":{\"frame\":%lu}}",
+            track, start_us, end_us - start_us, frame_ts);
+    pthread_mutex_unlock(&trace->lock);
+}
+
+void frame_trace_destroy(frame_trace_t* trace) {
+    if (!trace) return;
+    
+    fputs("\n]\n", trace->file);
+    fclose(trace->file);
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+}
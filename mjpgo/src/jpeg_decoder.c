@@ -1,53 +1,729 @@
 #include "../include/jpeg_decoder.h"
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <turbojpeg.h>
 
-jpeg_decoder_t* jpeg_decoder_create(uint32_t width, uint32_t height) {
+#define JPEG_DECODER_SLICE_QUEUE (JPEG_DECODER_MAX_THREADS * JPEG_DECODER_MAX_THREADS)
+
+typedef struct {
+    frame_ref_t* frame;
+    jpeg_image_t* image;
+    int format;
+    jpeg_image_sink_fn sink;
+    void* ctx;
+} decode_job_t;
+
+typedef struct {
+    jpeg_decoder_t* dec;
+    pthread_t thread;
+    tjhandle tj_instance;
+    uint8_t* chroma_buffer;
+    uint8_t* slice_buf;
+    size_t slice_buf_size;
+    size_t* restarts;
+    size_t restarts_size;
+    uint32_t index;
+} decode_worker_t;
+
+typedef struct {
+    size_t height_offset;
+    size_t scan_start;
+    size_t data_end;
+    uint32_t restart_interval;
+    uint32_t mcu_width;
+    uint32_t mcu_height;
+    const size_t* restarts;
+    uint32_t interval_count;
+} restart_layout_t;
+
+typedef struct {
+    int format;
+    uint32_t width;
+    uint8_t* planes[3];
+    int strides[3];
+    uint32_t chroma_shift;
+} decode_target_t;
+
+typedef struct {
+    uint32_t pending;
+    bool failed;
+} slice_group_t;
+
+typedef struct {
+    const uint8_t* jpeg;
+    const restart_layout_t* layout;
+    const decode_target_t* target;
+    slice_group_t* group;
+    uint32_t first_interval;
+    uint32_t end_interval;
+    uint32_t y;
+    uint32_t rows;
+    int result;
+} slice_task_t;
+
+/* Each worker owns a tjhandle; output images come from a shared pool and
+ * are reference counted so any number of consumers can hold on to one. */
+struct jpeg_decoder {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t slice_done;
+    decode_job_t* jobs;
+    uint32_t depth;
+    uint32_t head;
+    uint32_t count;
+    bool closed;
+    jpeg_image_t* images;
+    jpeg_image_t** free_images;
+    uint32_t image_count;
+    uint32_t free_count;
+    slice_task_t* slices[JPEG_DECODER_SLICE_QUEUE];
+    uint32_t slice_head;
+    uint32_t slice_count;
+    uint32_t max_slices;
+    decode_worker_t workers[JPEG_DECODER_MAX_THREADS];
+    uint32_t thread_count;
+    uint32_t max_width;
+    uint32_t max_height;
+    jpeg_decoder_stats_t stats;
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void halve_rows(uint8_t* dst, const uint8_t* src, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < (height + 1) / 2; y++) {
+        const uint8_t* a = src + (size_t)(2 * y) * width;
+        const uint8_t* b = 2 * y + 1 < height ? a + width : a;
+        uint8_t* out = dst + (size_t)y * width;
+        for (uint32_t x = 0; x < width; x++) {
+            out[x] = (uint8_t)((a[x] + b[x] + 1) >> 1);
+        }
+    }
+}
+
+static bool reserve(void** buf, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) return true;
+    
+    size_t size = *capacity ? *capacity : 4096;
+    while (size < needed) size *= 2;
+    
+    void* grown = realloc(*buf, size);
+    if (!grown) return false;
+    *buf = grown;
+    *capacity = size;
+    return true;
+}
+
+/* Finds the restart intervals of a single-scan baseline JPEG. Interval k
+ * starts at restarts[k] and ends at the RST marker before restarts[k + 1],
+ * or at the EOI marker for the last one. */
+static bool find_restarts(decode_worker_t* worker, const uint8_t* data, size_t len,
+                          restart_layout_t* layout) {
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+    
+    memset(layout, 0, sizeof(*layout));
+    uint32_t components = 0;
+    uint32_t h_max = 1;
+    uint32_t v_max = 1;
+    size_t pos = 2;
+    
+    while (layout->scan_start == 0) {
+        if (pos + 4 > len || data[pos] != 0xFF) return false;
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        
+        size_t seg_len = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if (seg_len < 2 || pos + 2 + seg_len > len) return false;
+        const uint8_t* seg = data + pos + 4;
+        
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (seg_len < 8) return false;
+            layout->height_offset = pos + 5;
+            components = seg[5];
+            if (components == 0 || seg_len < 8 + 3 * components) return false;
+            for (uint32_t c = 0; c < components; c++) {
+                uint32_t h = seg[7 + 3 * c] >> 4;
+                uint32_t v = seg[7 + 3 * c] & 0x0F;
+                if (h > h_max) h_max = h;
+                if (v > v_max) v_max = v;
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xCC) {
+            return false;
+        } else if (marker == 0xDD) {
+            if (seg_len < 4) return false;
+            layout->restart_interval = ((uint32_t)seg[0] << 8) | seg[1];
+        } else if (marker == 0xDA) {
+            if (components == 0 || seg[0] != components) return false;
+            layout->scan_start = pos + 2 + seg_len;
+        }
+        pos += 2 + seg_len;
+    }
+    
+    if (layout->restart_interval == 0) return false;
+    layout->mcu_width = 8 * h_max;
+    layout->mcu_height = 8 * v_max;
+    
+    uint32_t count = 0;
+    const uint8_t* p = data + layout->scan_start;
+    const uint8_t* end = data + len;
+    if (!reserve((void**)&worker->restarts, &worker->restarts_size, sizeof(size_t))) return false;
+    worker->restarts[count++] = layout->scan_start;
+    
+    while ((p = memchr(p, 0xFF, end - p)) != NULL && p + 1 < end) {
+        uint8_t marker = p[1];
+        if (marker == 0x00 || marker == 0xFF) {
+            p += marker == 0x00 ? 2 : 1;
+        } else if (marker >= 0xD0 && marker <= 0xD7) {
+            if (!reserve((void**)&worker->restarts, &worker->restarts_size, (count + 1) * sizeof(size_t))) {
+                return false;
+            }
+            worker->restarts[count++] = p + 2 - data;
+            p += 2;
+        } else if (marker == 0xD9) {
+            layout->data_end = p - data;
+            break;
+        } else {
+            return false;
+        }
+    }
+    
+    if (layout->data_end == 0) return false;
+    layout->restarts = worker->restarts;
+    layout->interval_count = count;
+    return true;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Splits the frame at MCU rows where a restart interval begins, into at
+ * most max_slices parts of about equal height. */
+static uint32_t plan_slices(const restart_layout_t* layout, uint32_t width, uint32_t height,
+                            uint32_t max_slices, slice_task_t* tasks) {
+    uint32_t mcus_per_row = (width + layout->mcu_width - 1) / layout->mcu_width;
+    uint32_t mcu_rows = (height + layout->mcu_height - 1) / layout->mcu_height;
+    uint32_t interval = layout->restart_interval;
+    uint64_t total = (uint64_t)mcus_per_row * mcu_rows;
+    if (layout->interval_count != (total + interval - 1) / interval) return 0;
+    
+    uint32_t row_step = interval / gcd(interval, mcus_per_row);
+    uint32_t count = 0;
+    uint32_t row = 0;
+    
+    for (uint32_t s = 1; s <= max_slices && row < mcu_rows; s++) {
+        uint32_t next = (uint32_t)((uint64_t)mcu_rows * s / max_slices);
+        next = (next + row_step - 1) / row_step * row_step;
+        if (next <= row) continue;
+        if (next > mcu_rows || s == max_slices) next = mcu_rows;
+        
+        slice_task_t* task = &tasks[count++];
+        task->first_interval = (uint32_t)((uint64_t)row * mcus_per_row / interval);
+        task->end_interval = next == mcu_rows ? layout->interval_count
+                                              : (uint32_t)((uint64_t)next * mcus_per_row / interval);
+        task->y = row * layout->mcu_height;
+        task->rows = (next == mcu_rows ? height : next * layout->mcu_height) - task->y;
+        row = next;
+    }
+    return count;
+}
+
+static int decode_rows(tjhandle tj_instance, const uint8_t* jpeg, size_t len,
+                       const decode_target_t* target, uint32_t y, uint32_t rows) {
+    if (target->format == JPEG_DECODE_RGB) {
+        return tjDecompress2(tj_instance, jpeg, len, target->planes[0] + (size_t)y * target->strides[0],
+                             target->width, target->strides[0], rows, TJPF_RGB, TJFLAG_FASTDCT);
+    }
+    
+    uint32_t chroma_y = y >> target->chroma_shift;
+    unsigned char* planes[3] = {
+        target->planes[0] + (size_t)y * target->strides[0],
+        target->planes[1] + (size_t)chroma_y * target->strides[1],
+        target->planes[2] + (size_t)chroma_y * target->strides[2],
+    };
+    int strides[3] = { target->strides[0], target->strides[1], target->strides[2] };
+    return tjDecompressToYUVPlanes(tj_instance, jpeg, len, planes, target->width, strides, rows,
+                                   TJFLAG_FASTDCT);
+}
+
+/* Each slice becomes a JPEG of its own: the original headers with the
+ * height patched, its restart intervals with markers renumbered from RST0,
+ * and EOI. Restart intervals reset DC prediction, so slices decode alone. */
+static void run_slice(decode_worker_t* worker, slice_task_t* task) {
+    const restart_layout_t* layout = task->layout;
+    const uint8_t* src = task->jpeg;
+    size_t needed = layout->scan_start + 2;
+    for (uint32_t k = task->first_interval; k < task->end_interval; k++) {
+        needed += (k + 1 < layout->interval_count ? layout->restarts[k + 1] : layout->data_end)
+                  - layout->restarts[k];
+    }
+    
+    task->result = -1;
+    if (!reserve((void**)&worker->slice_buf, &worker->slice_buf_size, needed)) return;
+    
+    uint8_t* out = worker->slice_buf;
+    memcpy(out, src, layout->scan_start);
+    out[layout->height_offset] = (uint8_t)(task->rows >> 8);
+    out[layout->height_offset + 1] = (uint8_t)task->rows;
+    size_t len = layout->scan_start;
+    
+    for (uint32_t k = task->first_interval; k < task->end_interval; k++) {
+        if (k > task->first_interval) {
+            out[len++] = 0xFF;
+            out[len++] = 0xD0 + ((k - task->first_interval - 1) & 7);
+        }
+        size_t end = k + 1 < layout->interval_count ? layout->restarts[k + 1] - 2 : layout->data_end;
+        memcpy(out + len, src + layout->restarts[k], end - layout->restarts[k]);
+        len += end - layout->restarts[k];
+    }
+    out[len++] = 0xFF;
+    out[len++] = 0xD9;
+    
+    task->result = decode_rows(worker->tj_instance, out, len, task->target, task->y, task->rows) < 0 ? -1 : 0;
+}
+
+static slice_task_t* pop_slice(jpeg_decoder_t* dec) {
+    slice_task_t* task = dec->slices[dec->slice_head];
+    dec->slice_head = (dec->slice_head + 1) % JPEG_DECODER_SLICE_QUEUE;
+    dec->slice_count--;
+    return task;
+}
+
+static void finish_slice(jpeg_decoder_t* dec, slice_task_t* task) {
+    pthread_mutex_lock(&dec->lock);
+    slice_group_t* group = task->group;
+    if (task->result < 0) group->failed = true;
+    if (--group->pending == 0) pthread_cond_broadcast(&dec->slice_done);
+    pthread_mutex_unlock(&dec->lock);
+}
+
+/* Other workers pick up queued slices before new frames; this worker
+ * decodes the first slice and then helps with whatever slices are queued
+ * until all of its own are done. */
+static int decode_sliced(decode_worker_t* worker, const frame_ref_t* frame, const decode_target_t* target,
+                         const restart_layout_t* layout, slice_task_t* tasks, uint32_t count) {
+    jpeg_decoder_t* dec = worker->dec;
+    slice_group_t group = { .pending = count, .failed = false };
+    
+    for (uint32_t i = 0; i < count; i++) {
+        tasks[i].jpeg = frame->data;
+        tasks[i].layout = layout;
+        tasks[i].target = target;
+        tasks[i].group = &group;
+    }
+    
+    pthread_mutex_lock(&dec->lock);
+    for (uint32_t i = 1; i < count; i++) {
+        dec->slices[(dec->slice_head + dec->slice_count++) % JPEG_DECODER_SLICE_QUEUE] = &tasks[i];
+    }
+    pthread_cond_broadcast(&dec->ready);
+    pthread_mutex_unlock(&dec->lock);
+    
+    run_slice(worker, &tasks[0]);
+    finish_slice(dec, &tasks[0]);
+    
+    pthread_mutex_lock(&dec->lock);
+    while (group.pending > 0) {
+        if (dec->slice_count == 0) {
+            pthread_cond_wait(&dec->slice_done, &dec->lock);
+            continue;
+        }
+        
+        slice_task_t* task = pop_slice(dec);
+        pthread_mutex_unlock(&dec->lock);
+        run_slice(worker, task);
+        finish_slice(dec, task);
+        pthread_mutex_lock(&dec->lock);
+    }
+    dec->stats.sliced++;
+    pthread_mutex_unlock(&dec->lock);
+    
+    return group.failed ? -1 : 0;
+}
+
+/* YUV output is 4:2:0; 4:2:2 chroma is decoded at full height to a scratch
+ * buffer and halved vertically afterwards. Other subsamplings decode to RGB. */
+static void prepare_target(decode_worker_t* worker, jpeg_image_t* image, int format, int subsamp,
+                           decode_target_t* target) {
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+    uint32_t chroma_width = (width + 1) / 2;
+    uint32_t chroma_height = (height + 1) / 2;
+    
+    if (subsamp != TJSAMP_420 && subsamp != TJSAMP_422 && subsamp != TJSAMP_GRAY) {
+        format = JPEG_DECODE_RGB;
+    }
+    
+    memset(target, 0, sizeof(*target));
+    target->format = format;
+    target->width = width;
+    image->format = format;
+    
+    if (format == JPEG_DECODE_RGB) {
+        image->planes[0] = image->data;
+        image->planes[1] = image->planes[2] = NULL;
+        image->strides[0] = width * 3;
+        image->strides[1] = image->strides[2] = 0;
+        target->planes[0] = image->planes[0];
+        target->strides[0] = image->strides[0];
+        return;
+    }
+    
+    image->planes[0] = image->data;
+    image->planes[1] = image->planes[0] + (size_t)width * height;
+    image->planes[2] = image->planes[1] + (size_t)chroma_width * chroma_height;
+    image->strides[0] = width;
+    image->strides[1] = image->strides[2] = chroma_width;
+    
+    for (int i = 0; i < 3; i++) {
+        target->planes[i] = image->planes[i];
+        target->strides[i] = image->strides[i];
+    }
+    target->chroma_shift = 1;
+    
+    if (subsamp == TJSAMP_422) {
+        target->planes[1] = worker->chroma_buffer;
+        target->planes[2] = worker->chroma_buffer + (size_t)chroma_width * height;
+        target->chroma_shift = 0;
+    }
+}
+
+static void finish_target(jpeg_image_t* image, int subsamp, const decode_target_t* target) {
+    if (image->format != JPEG_DECODE_YUV) return;
+    
+    uint32_t chroma_width = (image->width + 1) / 2;
+    uint32_t chroma_height = (image->height + 1) / 2;
+    
+    if (subsamp == TJSAMP_422) {
+        halve_rows(image->planes[1], target->planes[1], chroma_width, image->height);
+        halve_rows(image->planes[2], target->planes[2], chroma_width, image->height);
+    } else if (subsamp == TJSAMP_GRAY) {
+        memset(image->planes[1], 128, (size_t)chroma_width * chroma_height * 2);
+    }
+}
+
+static int decode_frame(decode_worker_t* worker, jpeg_image_t* image, const frame_ref_t* frame,
+                        int format) {
+    jpeg_decoder_t* dec = worker->dec;
+    int width, height, subsamp, colorspace;
+    if (tjDecompressHeader3(worker->tj_instance, frame->data, frame->len,
+                            &width, &height, &subsamp, &colorspace) < 0) {
+        return -1;
+    }
+    
+    if ((uint32_t)width > dec->max_width || (uint32_t)height > dec->max_height) return -1;
+    
+    image->width = width;
+    image->height = height;
+    
+    decode_target_t target;
+    prepare_target(worker, image, format, subsamp, &target);
+    
+    uint32_t max_slices = dec->max_slices < dec->thread_count ? dec->max_slices : dec->thread_count;
+    uint32_t slice_count = 0;
+    restart_layout_t layout;
+    slice_task_t tasks[JPEG_DECODER_MAX_THREADS];
+    
+    if (max_slices > 1 && (uint64_t)width * height >= JPEG_DECODER_SLICE_MIN_PIXELS &&
+        find_restarts(worker, frame->data, frame->len, &layout)) {
+        /* Fancy upsampling of vertically subsampled chroma to RGB blends
+         * across slice edges, so those frames stay serial. */
+        if (target.format == JPEG_DECODE_YUV || layout.mcu_height == 8) {
+            slice_count = plan_slices(&layout, width, height, max_slices, tasks);
+        }
+    }
+    
+    int result;
+    if (slice_count > 1) {
+        result = decode_sliced(worker, frame, &target, &layout, tasks, slice_count);
+    } else {
+        result = decode_rows(worker->tj_instance, frame->data, frame->len, &target, 0, height) < 0 ? -1 : 0;
+    }
+    if (result < 0) return -1;
+    
+    finish_target(image, subsamp, &target);
+    return 0;
+}
+
+static void* decode_thread(void* arg) {
+    decode_worker_t* worker = arg;
+    jpeg_decoder_t* dec = worker->dec;
+    
+    for (;;) {
+        pthread_mutex_lock(&dec->lock);
+        while (dec->slice_count == 0 && dec->count == 0 && !dec->closed) {
+            pthread_cond_wait(&dec->ready, &dec->lock);
+        }
+        
+        if (dec->slice_count > 0) {
+            slice_task_t* task = pop_slice(dec);
+            pthread_mutex_unlock(&dec->lock);
+            run_slice(worker, task);
+            finish_slice(dec, task);
+            continue;
+        }
+        
+        if (dec->count == 0) {
+            pthread_mutex_unlock(&dec->lock);
+            break;
+        }
+        
+        decode_job_t job = dec->jobs[dec->head];
+        dec->head = (dec->head + 1) % dec->depth;
+        dec->count--;
+        pthread_mutex_unlock(&dec->lock);
+        
+        uint64_t start = now_us();
+        int result = decode_frame(worker, job.image, job.frame, job.format);
+        job.image->timestamp_us = job.frame->timestamp_us;
+        job.image->decode_us = now_us() - start;
+        job.image->worker = worker->index;
+        frame_ref_release(job.frame);
+        
+        pthread_mutex_lock(&dec->lock);
+        if (result == 0) dec->stats.decoded++;
+        else dec->stats.failed++;
+        pthread_mutex_unlock(&dec->lock);
+        
+        if (result == 0) job.sink(job.ctx, job.image);
+        jpeg_image_release(job.image);
+    }
+    
+    return NULL;
+}
+
+static int start_worker(jpeg_decoder_t* dec, uint32_t index) {
+    decode_worker_t* worker = &dec->workers[index];
+    worker->dec = dec;
+    worker->index = index;
+    
+    worker->tj_instance = tjInitDecompress();
+    if (!worker->tj_instance) return -1;
+    
+    worker->chroma_buffer = malloc((size_t)(dec->max_width + 1) / 2 * dec->max_height * 2);
+    if (!worker->chroma_buffer) {
+        tjDestroy(worker->tj_instance);
+        return -1;
+    }
+    
+    if (pthread_create(&worker->thread, NULL, decode_thread, worker) != 0) {
+        free(worker->chroma_buffer);
+        tjDestroy(worker->tj_instance);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_workers(jpeg_decoder_t* dec) {
+    pthread_mutex_lock(&dec->lock);
+    bool stopped = dec->closed;
+    dec->closed = true;
+    pthread_cond_broadcast(&dec->ready);
+    pthread_mutex_unlock(&dec->lock);
+    if (stopped) return;
+    
+    for (uint32_t i = 0; i < dec->thread_count; i++) {
+        pthread_join(dec->workers[i].thread, NULL);
+        free(dec->workers[i].restarts);
+        free(dec->workers[i].slice_buf);
+        free(dec->workers[i].chroma_buffer);
+        tjDestroy(dec->workers[i].tj_instance);
+    }
+}
+
+/* The queue holds one pending job per worker, and each job takes its output
+ * image from the pool up front, so workers never wait for one. */
+jpeg_decoder_t* jpeg_decoder_create(uint32_t thread_count, uint32_t image_count,
+                                    uint32_t max_width, uint32_t max_height) {
+    if (thread_count == 0 || thread_count > JPEG_DECODER_MAX_THREADS) return NULL;
+    if (image_count <= thread_count * 2 || max_width == 0 || max_height == 0) return NULL;
+    
     jpeg_decoder_t* dec = calloc(1, sizeof(*dec));
     if (!dec) return NULL;
     
-    dec->tj_instance = tjInitDecompress();
-    if (!dec->tj_instance) {
-        free(dec);
-        return NULL;
+    dec->depth = thread_count;
+    dec->max_width = max_width;
+    dec->max_height = max_height;
+    dec->jobs = calloc(dec->depth, sizeof(decode_job_t));
+    dec->images = calloc(image_count, sizeof(jpeg_image_t));
+    dec->free_images = calloc(image_count, sizeof(jpeg_image_t*));
+    if (!dec->jobs || !dec->images || !dec->free_images) goto fail;
+    
+    size_t image_size = (size_t)max_width * max_height * 3;
+    for (uint32_t i = 0; i < image_count; i++) {
+        jpeg_image_t* image = &dec->images[i];
+        image->dec = dec;
+        image->capacity = image_size;
+        image->data = tjAlloc(image_size);
+        if (!image->data) goto fail;
+        atomic_init(&image->refs, 0);
+        dec->free_images[i] = image;
+        dec->image_count++;
     }
+    dec->free_count = image_count;
     
-    dec->width = width;
-    dec->height = height;
-    dec->rgb_size = (size_t)width * height * 3;
-    dec->rgb_buffer = tjAlloc(dec->rgb_size);
+    pthread_mutex_init(&dec->lock, NULL);
+    pthread_cond_init(&dec->ready, NULL);
+    pthread_cond_init(&dec->slice_done, NULL);
+    dec->max_slices = thread_count;
     
-    if (!dec->rgb_buffer) {
-        tjDestroy(dec->tj_instance);
-        free(dec);
-        return NULL;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        if (start_worker(dec, i) < 0) {
+            jpeg_decoder_destroy(dec);
+            return NULL;
+        }
+        dec->thread_count++;
     }
     
     return dec;
+
+fail:
+    for (uint32_t i = 0; i < dec->image_count; i++) tjFree(dec->images[i].data);
+    free(dec->free_images);
+    free(dec->images);
+    free(dec->jobs);
+    free(dec);
+    return NULL;
+}
+
+/* Frames of at least JPEG_DECODER_SLICE_MIN_PIXELS with restart markers are
+ * split into up to this many slices decoded in parallel; 1 disables it. */
+int jpeg_decoder_set_slices(jpeg_decoder_t* dec, uint32_t max_slices) {
+    if (!dec || max_slices == 0 || max_slices > JPEG_DECODER_MAX_THREADS) return -1;
+    
+    pthread_mutex_lock(&dec->lock);
+    dec->max_slices = max_slices;
+    pthread_mutex_unlock(&dec->lock);
+    return 0;
+}
+
+uint32_t jpeg_decoder_threads(const jpeg_decoder_t* dec) {
+    return dec ? dec->thread_count : 0;
 }
 
-int jpeg_decoder_decode(jpeg_decoder_t* dec, const void* jpeg_data, size_t jpeg_len) {
-    if (!dec || !jpeg_data || jpeg_len == 0) return -1;
+/* Frames the decoder may hold at once: one queued and one in progress per
+ * worker. */
+uint32_t jpeg_decoder_capacity(const jpeg_decoder_t* dec) {
+    return dec ? dec->depth + dec->thread_count : 0;
+}
+
+/* A frame still queued for the same sink and context is replaced by the
+ * newer one, which returns 1; -1 means the frame was not accepted. */
+int jpeg_decoder_submit(jpeg_decoder_t* dec, frame_ref_t* frame, int format,
+                        jpeg_image_sink_fn sink, void* ctx) {
+    if (!dec || !frame || !sink) return -1;
+    if (format != JPEG_DECODE_YUV && format != JPEG_DECODE_RGB) return -1;
+    
+    frame_ref_t* replaced = NULL;
+    int result = 0;
     
-    int result = tjDecompress2(
-        dec->tj_instance,
-        (unsigned char*)jpeg_data,
-        jpeg_len,
-        dec->rgb_buffer,
-        dec->width,
-        0,
-        dec->height,
-        TJPF_RGB,
-        TJFLAG_FASTDCT
-    );
+    pthread_mutex_lock(&dec->lock);
+    
+    for (uint32_t i = 0; i < dec->count; i++) {
+        decode_job_t* job = &dec->jobs[(dec->head + i) % dec->depth];
+        if (job->sink == sink && job->ctx == ctx && job->format == format) {
+            replaced = job->frame;
+            job->frame = frame;
+            result = 1;
+            break;
+        }
+    }
     
-    return (result == 0) ? 0 : -1;
+    if (!replaced) {
+        if (dec->closed || dec->count == dec->depth || dec->free_count == 0) {
+            pthread_mutex_unlock(&dec->lock);
+            return -1;
+        }
+        
+        jpeg_image_t* image = dec->free_images[--dec->free_count];
+        atomic_store_explicit(&image->refs, 1, memory_order_relaxed);
+        
+        decode_job_t* job = &dec->jobs[(dec->head + dec->count) % dec->depth];
+        job->frame = frame;
+        job->image = image;
+        job->format = format;
+        job->sink = sink;
+        job->ctx = ctx;
+        dec->count++;
+        pthread_cond_signal(&dec->ready);
+    }
+    
+    frame_ref_retain(frame);
+    pthread_mutex_unlock(&dec->lock);
+    
+    frame_ref_release(replaced);
+    return result;
+}
+
+void jpeg_image_retain(jpeg_image_t* image) {
+    if (!image) return;
+    atomic_fetch_add_explicit(&image->refs, 1, memory_order_relaxed);
+}
+
+void jpeg_image_release(jpeg_image_t* image) {
+    if (!image) return;
+    if (atomic_fetch_sub_explicit(&image->refs, 1, memory_order_acq_rel) != 1) return;
+    
+    jpeg_decoder_t* dec = image->dec;
+    pthread_mutex_lock(&dec->lock);
+    dec->free_images[dec->free_count++] = image;
+    pthread_mutex_unlock(&dec->lock);
+}
+
+jpeg_decoder_stats_t jpeg_decoder_stats(jpeg_decoder_t* dec) {
+    jpeg_decoder_stats_t stats = {0};
+    if (!dec) return stats;
+    
+    pthread_mutex_lock(&dec->lock);
+    stats = dec->stats;
+    pthread_mutex_unlock(&dec->lock);
+    return stats;
+}
+
+/* Stops the workers and drops queued frames; images still held by
+ * consumers stay valid until jpeg_decoder_destroy(). */
+void jpeg_decoder_close(jpeg_decoder_t* dec) {
+    if (!dec) return;
+    
+    stop_workers(dec);
+    
+    while (dec->count > 0) {
+        decode_job_t* job = &dec->jobs[dec->head];
+        frame_ref_release(job->frame);
+        jpeg_image_release(job->image);
+        dec->head = (dec->head + 1) % dec->depth;
+        dec->count--;
+    }
 }
 
 void jpeg_decoder_destroy(jpeg_decoder_t* dec) {
     if (!dec) return;
-    if (dec->rgb_buffer) tjFree(dec->rgb_buffer);
-    if (dec->tj_instance) tjDestroy(dec->tj_instance);
+    
+    jpeg_decoder_close(dec);
+    
+    for (uint32_t i = 0; i < dec->image_count; i++) {
+        tjFree(dec->images[i].data);
+    }
+    
+    pthread_cond_destroy(&dec->slice_done);
+    pthread_cond_destroy(&dec->ready);
+    pthread_mutex_destroy(&dec->lock);
+    free(dec->free_images);
+    free(dec->images);
+    free(dec->jobs);
     free(dec);
 }
@@ -0,0 +1,91 @@
+#include "../include/latency_histogram.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char dump_bar[] = "########################################";
+#define DUMP_BAR_WIDTH (sizeof(dump_bar) - 1)
+
+/* Log-linear buckets: values below 2 * SUB_COUNT map one-to-one, above that
+ * each power of two is split into SUB_COUNT equal buckets, so a bucket is
+ * never wider than 1/SUB_COUNT of its value. */
+static inline uint32_t bucket_index(uint64_t value) {
+    if (value < 2 * LATENCY_HISTOGRAM_SUB_COUNT) return (uint32_t)value;
+    
+    uint32_t msb = 63 - __builtin_clzll(value);
+    uint32_t shift = msb - LATENCY_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * LATENCY_HISTOGRAM_SUB_COUNT +
+           (uint32_t)((value >> shift) - LATENCY_HISTOGRAM_SUB_COUNT);
+}
+
+static uint64_t bucket_upper(uint32_t index) {
+    if (index < 2 * LATENCY_HISTOGRAM_SUB_COUNT) return index;
+    
+    uint32_t shift = index / LATENCY_HISTOGRAM_SUB_COUNT - 1;
+    uint64_t lower = (uint64_t)(LATENCY_HISTOGRAM_SUB_COUNT + index % LATENCY_HISTOGRAM_SUB_COUNT) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+void latency_histogram_reset(latency_histogram_t* hist) {
+    if (!hist) return;
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void latency_histogram_record(latency_histogram_t* hist, uint64_t value) {
+    hist->counts[bucket_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value < hist->min) hist->min = value;
+    if (value > hist->max) hist->max = value;
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram_t* hist, double percentile) {
+    if (!hist || hist->count == 0) return 0;
+    
+    uint64_t target = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+    if (target == 0) target = 1;
+    
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= target) {
+            uint64_t upper = bucket_upper(i);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+    
+    return hist->max;
+}
+
+void latency_histogram_print(const latency_histogram_t* hist, const char* title, const char* unit) {
+    if (!hist || hist->count == 0) return;
+    
+    printf("%s:\n", title);
+    printf("  Average:  %lu %s\n", hist->sum / hist->count, unit);
+    printf("  Min:      %lu %s\n", hist->min, unit);
+    printf("  p50:      %lu %s\n", latency_histogram_percentile(hist, 50.0), unit);
+    printf("  p90:      %lu %s\n", latency_histogram_percentile(hist, 90.0), unit);
+    printf("  p99:      %lu %s\n", latency_histogram_percentile(hist, 99.0), unit);
+    printf("  p99.9:    %lu %s\n", latency_histogram_percentile(hist, 99.9), unit);
+    printf("  Max:      %lu %s\n", hist->max, unit);
+    
+    /* The dump folds buckets into powers of two to stay readable */
+    uint64_t ranges[65] = {0};
+    uint64_t peak = 0;
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (hist->counts[i] == 0) continue;
+        uint64_t upper = bucket_upper(i);
+        uint32_t range = upper == 0 ? 0 : 64 - __builtin_clzll(upper);
+        ranges[range] += hist->counts[i];
+        if (ranges[range] > peak) peak = ranges[range];
+    }
+    
+    for (uint32_t r = 0; r < 65; r++) {
+        if (ranges[r] == 0) continue;
+        
+        uint64_t low = r == 0 ? 0 : 1ULL << (r - 1);
+        uint64_t high = r == 0 ? 0 : r == 64 ? UINT64_MAX : (1ULL << r) - 1;
+        int bar = (int)((ranges[r] * DUMP_BAR_WIDTH + peak - 1) / peak);
+        printf("  %9lu - %-9lu %8lu %.*s\n", low, high, ranges[r], bar, dump_bar);
+    }
+}
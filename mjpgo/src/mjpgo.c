@@ -3,19 +3,42 @@
 #include "../include/udp_receiver.h"
 #include "../include/video_capturer.h"
 #include "../include/frame_pipe.h"
+#include "../include/frame_player.h"
 #include "../include/frame_recorder.h"
+#include "../include/test_source.h"
 #include "../include/display_renderer.h"
+#include "../include/jpeg_decoder.h"
+#include "../include/frame_ring.h"
+#include "../include/latency_histogram.h"
+#include "../include/frame_trace.h"
+#include "../include/bench.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
 
 #define MAX_OUTPUTS 8
+#define MAX_CAPTURES 8
 #define OUTPUT_TYPE_SEND 1
 #define OUTPUT_TYPE_RECORD 2
 #define OUTPUT_TYPE_PIPE 3
 #define OUTPUT_TYPE_RENDER 4
+#define RECORD_QUEUE_DEPTH 16
+#define RECORD_SPILL_MB 256
+#define PIPE_QUEUE_DEPTH 4
+#define RENDER_POLL_MS 10
+#define TRACE_TRACKS_PER_INPUT (MAX_OUTPUTS + 1)
+#define TRACE_DECODER_TRACK (MAX_CAPTURES * TRACE_TRACKS_PER_INPUT)
+#define CAPTURE_SPARE_BUFFERS 2
+#define CAPTURE_POLL_MS 100
+#define REPLAY_POLL_MS 100
 
 typedef struct {
     int type;
@@ -26,20 +49,129 @@ typedef struct {
         display_renderer_t* renderer;
     } handle;
     uint32_t send_rounds;
+    uint32_t queue_depth;
+    uint32_t spill_mb;
+    frame_queue_t* queue;
+    pthread_t worker;
+    bool worker_started;
+    uint32_t trace_track;
 } output_slot_t;
 
 typedef struct {
-    bool enabled;
+    int tx_mode;
+    uint32_t zerocopy_threshold;
+    uint32_t fec_k;
+    uint32_t nack_deadline_ms;
+    bool clock_sync;
+    double pace_mbps;
+    uint32_t burst_bytes;
+} send_options_t;
+
+typedef struct {
+    uint32_t queue_depth;
+    uint32_t spill_mb;
+    uint32_t sync_ms;
+    uint32_t segment_s;
+    uint32_t segment_mb;
+} record_options_t;
+
+typedef struct {
+    uint32_t buffer_count;
+    bool latest_only;
+} capture_options_t;
+
+typedef struct {
+    int rx_mode;
+    uint32_t batch_size;
+    uint32_t slot_count;
+    uint32_t deadline_ms;
+    uint32_t nack_interval_ms;
+    bool clock_sync;
+} receive_options_t;
+
+typedef struct {
+    double speed;
+    uint32_t loops;
+    double start_s;
+} replay_options_t;
+
+typedef struct {
+    uint32_t frames;
+    uint64_t count;
+} testsrc_options_t;
+
+typedef struct {
     uint64_t first_frame_time;
     uint64_t last_frame_time;
     uint64_t frame_count;
-    uint64_t total_latency;
-    uint64_t min_latency;
-    uint64_t max_latency;
+    latency_histogram_t latency;
+    latency_histogram_t interval;
 } profile_stats_t;
 
+typedef struct pipeline pipeline_t;
+
+typedef struct {
+    pipeline_t* pl;
+    int format;
+    uint64_t dropped;
+} decode_target_t;
+
+struct pipeline {
+    char name[64];
+    uint32_t width;
+    uint32_t height;
+    output_slot_t outputs[MAX_OUTPUTS];
+    int output_count;
+    frame_ring_t* ring;
+    frame_ring_t* borrowed;
+    video_capturer_t* cap;
+    udp_receiver_t* recv;
+    uint32_t trace_track;
+    profile_stats_t profile;
+    decode_target_t decode_targets[2];
+    uint64_t ring_full;
+    uint64_t oversize;
+    bool wait_outputs;
+};
+
+typedef struct {
+    pipeline_t* pipelines;
+    int count;
+} input_set_t;
+
+typedef struct {
+    pipeline_t* pl;
+    frame_player_t* player;
+    replay_options_t opts;
+    const char* filename;
+    uint32_t segment;
+    uint64_t first_start_us;
+    uint64_t frame_interval_us;
+    uint64_t pts_offset_us;
+    uint64_t last_pts_us;
+    uint64_t frames;
+    uint64_t elapsed_us;
+} replay_t;
+
+typedef struct {
+    pipeline_t* pl;
+    test_source_t* src;
+    testsrc_options_t opts;
+    double fps;
+    uint64_t frames;
+    uint64_t late;
+    uint64_t elapsed_us;
+} testsrc_t;
+
 static volatile bool running = true;
-static profile_stats_t profile = {0};
+static bool profile_enabled = false;
+static frame_trace_t* trace = NULL;
+static jpeg_decoder_t* decoder = NULL;
+static uint32_t decoder_threads = 0;
+static uint32_t decoder_slices = 0;
+static pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_ready = PTHREAD_COND_INITIALIZER;
+static uint64_t render_seq = 0;
 
 static void signal_handler(int sig) {
     (void)sig;
@@ -49,72 +181,286 @@ static void signal_handler(int sig) {
 static void print_usage(void) {
     printf("mjpgo - Lightning Fast MJPEG Streaming\n\n");
     printf("Usage:\n");
-    printf("  mjpgo [--profile] [input] [outputs...]\n\n");
+    printf("  mjpgo [--profile] [--trace FILE] [--decoders N] [--slices N] [input] [outputs...]\n\n");
     printf("Options:\n");
-    printf("  --profile    Enable latency profiling (stats on SIGINT)\n\n");
+    printf("  --profile    Enable latency profiling (stats on SIGINT)\n");
+    printf("  --trace FILE Write per-frame stage timings as Chrome trace JSON\n");
+    printf("  --decoders N JPEG decode threads shared by all render outputs\n");
+    printf("  --slices N   Max parallel slices per frame with restart markers (1 = off)\n\n");
     printf("Input (exactly one):\n");
-    printf("  capture DEVICE WIDTH HEIGHT FPS_NUM FPS_DEN\n");
-    printf("  receive IP PORT PACKET_LEN JPEG_LEN WIDTH HEIGHT FPS_NUM FPS_DEN\n\n");
+    printf("  capture DEVICE WIDTH HEIGHT FPS_NUM FPS_DEN [OPTIONS] [outputs...]\n");
+    printf("               Repeat capture with its own outputs to serve several cameras\n");
+    printf("  receive IP PORT PACKET_LEN JPEG_LEN WIDTH HEIGHT FPS_NUM FPS_DEN [OPTIONS]\n");
+    printf("  replay FILE.mkv [OPTIONS]\n");
+    printf("  testsrc WIDTH HEIGHT FPS QUALITY gradient|noise|box [OPTIONS]\n\n");
     printf("Output (at least one):\n");
-    printf("  send LOCAL_IP LOCAL_PORT REMOTE_IP REMOTE_PORT PACKET_LEN JPEG_LEN ROUNDS\n");
-    printf("  record FILENAME\n");
-    printf("  pipe FD CHUNK_SIZE\n");
-    printf("  render WINDOW_WIDTH WINDOW_HEIGHT\n\n");
+    printf("  send LOCAL_IP LOCAL_PORT REMOTE_IP REMOTE_PORT PACKET_LEN JPEG_LEN ROUNDS [OPTIONS]\n");
+    printf("  record FILENAME [OPTIONS]\n");
+    printf("  pipe FD PIPE_SIZE\n");
+    printf("  render WINDOW_WIDTH WINDOW_HEIGHT [OPTIONS]\n\n");
+    printf("Capture options:\n");
+    printf("  buffers=N        V4L2 buffers to request (default %d)\n", CAPTURER_BUFFER_COUNT_DEFAULT);
+    printf("  latest=0|1       Skip to the newest captured frame when outputs fall behind\n\n");
+    printf("Replay options:\n");
+    printf("  speed=X|max      Pace frames at X times their recorded rate, or wait only for\n");
+    printf("                   send, record and pipe queues; render shows the newest (default 1)\n");
+    printf("  loop=N           Play the file N times (default 1, 0 repeats until stopped)\n");
+    printf("  start=SECONDS    Start this far into the recording, seeking with the index\n\n");
+    printf("Testsrc options:\n");
+    printf("  frames=N         Distinct frames encoded up front and cycled (default %d)\n",
+           TEST_SOURCE_FRAMES_DEFAULT);
+    printf("  count=N          Stop after N frames (default 0, runs until stopped)\n\n");
+    printf("Receive options:\n");
+    printf("  rx=recvfrom|mmsg|gro\n");
+    printf("                   Per-packet recvfrom, batched recvmmsg with direct placement,\n");
+    printf("                   or UDP_GRO coalesced receive\n");
+    printf("  batch=N          Datagrams per recvmmsg with rx=mmsg\n");
+    printf("  slots=N          Frames reassembled concurrently (default %d)\n", UDP_RECEIVER_SLOTS_DEFAULT);
+    printf("  deadline=MS      Drop incomplete frames after MS (default %d)\n", UDP_RECEIVER_DEADLINE_DEFAULT_MS);
+    printf("  nack=MS          NACK missing segments, retrying every MS (0 disables)\n");
+    printf("  clock=0|1        Estimate the sender's clock offset for latency stats\n\n");
+    printf("Send options:\n");
+    printf("  tx=copy|mmsg|gso Per-packet sendto, batched scatter-gather sendmmsg,\n");
+    printf("                   or UDP_SEGMENT offload (wire format unchanged)\n");
+    printf("  zerocopy=BYTES   MSG_ZEROCOPY for frames of at least BYTES with tx=mmsg (0 disables)\n");
+    printf("  fec=K            One XOR parity packet per K segments (0 disables)\n");
+    printf("  nack=MS          Resend NACKed segments of frames sent within MS (0 disables)\n");
+    printf("  clock=0|1        Answer the receiver's clock pings\n");
+    printf("  pace=MBPS        Cap the send rate with a token bucket (0 disables)\n");
+    printf("  burst=BYTES      Token bucket depth for pace (default %d)\n\n", UDP_SENDER_BURST_DEFAULT);
+    printf("Record options:\n");
+    printf("  queue=N          Frames queued while storage catches up (default %d)\n", RECORD_QUEUE_DEPTH);
+    printf("  spill=MB         Copy frames past a full queue to memory, up to MB (default %d, 0 drops)\n",
+           RECORD_SPILL_MB);
+    printf("  sync=MS          Flush and fdatasync the file every MS (default %d, 0 only on close)\n",
+           FRAME_RECORDER_SYNC_DEFAULT_MS);
+    printf("  segment=SECONDS  Start a new FILENAME-NNNN.mkv with a .idx index every SECONDS\n");
+    printf("  segment_mb=MB    Start a new segment after MB megabytes\n\n");
+    printf("Render options:\n");
+    printf("  decode=yuv|rgb   Decode to YUV planes for the GPU to convert, or to RGB on the CPU\n\n");
     printf("Commands:\n");
     printf("  help         Show this message\n");
-    printf("  devices      List V4L2 devices with MJPEG support\n\n");
+    printf("  devices      List V4L2 devices with MJPEG support\n");
+    printf("  bench offload [FRAME_LEN PACKET_LEN FPS SECONDS]\n");
+    printf("               Loopback send/receive throughput with and without offload\n");
+    printf("  bench fec [FRAME_LEN PACKET_LEN FPS SECONDS]\n");
+    printf("               Wire bytes and delivered frames for ROUNDS, FEC and NACK under loss\n");
+    printf("  bench transport [frame=N,.. packet=N,.. rounds=N,.. fps=N seconds=S loss=PCT burst=PCT\n");
+    printf("                  burst_len=N reorder=PCT dup=PCT delay=MS jitter=MS seed=N json=FILE|-]\n");
+    printf("               Delivery, reassembly latency and CPU per frame through an impaired relay\n");
+    printf("  bench decode FILE.jpg [SECONDS]\n");
+    printf("               Serial vs restart-sliced decode time per frame by thread count\n");
+    printf("  bench micro [SECONDS [FILE.jpg...]]\n");
+    printf("               Decode, copy, pipe and record cost per frame with warm and cold caches\n\n");
     printf("Examples:\n");
     printf("  mjpgo capture /dev/video0 640 480 1 30 render 1280 720\n");
     printf("  mjpgo capture /dev/video0 640 480 1 30 send 0.0.0.0 5000 192.168.1.2 5001 1400 500000 1\n");
     printf("  mjpgo receive 0.0.0.0 5001 1400 500000 640 480 1 30 render 1280 720\n");
+    printf("  mjpgo testsrc 3840 2160 120 90 gradient send 0.0.0.0 5000 127.0.0.1 5001 1400 1000000 1\n");
+}
+
+static const char* output_type_name(int type) {
+    switch (type) {
+        case OUTPUT_TYPE_SEND: return "send";
+        case OUTPUT_TYPE_RECORD: return "record";
+        case OUTPUT_TYPE_PIPE: return "pipe";
+        case OUTPUT_TYPE_RENDER: return "render";
+    }
+    return "unknown";
 }
 
-static void print_profile_stats(void) {
-    if (!profile.enabled || profile.frame_count == 0) return;
+static uint64_t output_dropped(const pipeline_t* pl, const output_slot_t* out) {
+    if (out->type == OUTPUT_TYPE_PIPE) {
+        const frame_pipe_stats_t* st = &out->handle.pipe->stats;
+        return frame_queue_dropped(out->queue) + st->dropped + st->oversize;
+    }
+    if (out->type != OUTPUT_TYPE_RENDER) return frame_queue_dropped(out->queue);
     
-    printf("\n--- Profiling Statistics ---\n");
-    printf("Frames:     %lu\n", profile.frame_count);
+    int format = display_renderer_decode_format(out->handle.renderer);
+    return pl->decode_targets[format].dropped;
+}
+
+static void print_render_path(const char* label, const display_path_stats_t* st) {
+    if (st->frames == 0) return;
     
-    if (profile.first_frame_time != profile.last_frame_time) {
-        double duration_s = (profile.last_frame_time - profile.first_frame_time) / 1000000.0;
-        double fps = profile.frame_count / duration_s;
+    printf("  %s:      %.1f us decode", label, (double)st->decode_us / st->frames);
+    if (st->uploads > 0) printf(" + %.1f us upload", (double)st->upload_us / st->uploads);
+    printf(" per frame (%lu frames)\n", st->frames);
+}
+
+static void print_profile_stats(const pipeline_t* pl) {
+    const profile_stats_t* profile = &pl->profile;
+    if (!profile_enabled || profile->frame_count == 0) return;
+    
+    const output_slot_t* outputs = pl->outputs;
+    int count = pl->output_count;
+    
+    printf("\n--- Profiling Statistics: %s ---\n", pl->name);
+    printf("Frames:     %lu\n", profile->frame_count);
+    
+    if (profile->first_frame_time != profile->last_frame_time) {
+        double duration_s = (profile->last_frame_time - profile->first_frame_time) / 1000000.0;
+        double fps = profile->frame_count / duration_s;
         printf("Duration:   %.2f seconds\n", duration_s);
         printf("Average:    %.2f fps\n", fps);
     }
     
-    if (profile.total_latency > 0) {
-        printf("Latency:\n");
-        printf("  Average:  %lu us\n", profile.total_latency / profile.frame_count);
-        printf("  Min:      %lu us\n", profile.min_latency);
-        printf("  Max:      %lu us\n", profile.max_latency);
+    latency_histogram_print(&profile->latency, "Latency", "us");
+    latency_histogram_print(&profile->interval, "Interval", "us");
+    
+    printf("Dropped:\n");
+    if (pl->cap && pl->cap->latest_only) {
+        printf("  %-9s %lu frames\n", "stale", pl->cap->stale_frames);
+    }
+    if (pl->ring_full > 0) printf("  %-9s %lu frames\n", "no slot", pl->ring_full);
+    if (pl->oversize > 0) printf("  %-9s %lu frames\n", "oversize", pl->oversize);
+    for (int i = 0; i < count; i++) {
+        printf("  %-9s %lu frames\n", output_type_name(outputs[i].type), output_dropped(pl, &outputs[i]));
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].type != OUTPUT_TYPE_SEND) continue;
+        
+        const udp_sender_stats_t* st = &outputs[i].handle.sender->stats;
+        if (st->frames == 0) continue;
+        
+        printf("Send:\n");
+        printf("  Syscalls: %.1f per frame\n", (double)st->syscalls / st->frames);
+        printf("  CPU:      %.1f us per frame\n", st->cpu_ns / 1000.0 / st->frames);
+        if (st->zerocopy_frames > 0) {
+            printf("  Zerocopy: %lu frames in %lu messages (%lu copied by the kernel)\n",
+                   st->zerocopy_frames, st->zerocopy_sends, st->zerocopy_copied);
+        }
+        if (st->fec_packets > 0) {
+            printf("  Parity:   %.1f packets per frame\n", (double)st->fec_packets / st->frames);
+        }
+        if (st->nacks > 0) {
+            printf("  NACKs:    %lu (%lu segments resent, %lu past deadline)\n",
+                   st->nacks, st->retransmits, st->nacks_expired);
+        }
+        if (st->pongs > 0) {
+            printf("  Clock:    %lu pings answered\n", st->pongs);
+        }
+        if (outputs[i].handle.sender->pace_bytes_per_s > 0) {
+            printf("  Pacing:   %.1f us per frame (max %lu us)\n",
+                   (double)st->pace_delay_us / st->frames, st->pace_delay_max_us);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].type != OUTPUT_TYPE_RECORD) continue;
+        
+        const frame_recorder_stats_t* st = frame_recorder_stats(outputs[i].handle.recorder);
+        if (st->frames == 0) continue;
+        
+        printf("Record:\n");
+        printf("  Written:  %lu frames, %.1f MB in %lu writes (%lu failed)\n",
+               st->frames, st->bytes / 1e6, st->writes, st->failed);
+        if (st->writes > 0) {
+            printf("  Write:    %.1f us average, %lu us max\n",
+                   (double)st->write_us / st->writes, st->write_max_us);
+        }
+        if (st->syncs > 0) {
+            printf("  Sync:     %lu times, %.1f us average, %lu us max\n",
+                   st->syncs, (double)st->sync_us / st->syncs, st->sync_max_us);
+        }
+        uint64_t spilled = frame_queue_spilled(outputs[i].queue);
+        if (spilled > 0) {
+            printf("  Spilled:  %lu frames past the queue, %.1f MB peak\n",
+                   spilled, frame_queue_spill_peak(outputs[i].queue) / 1e6);
+        }
+        if (st->segments > 1) {
+            printf("  Segments: %lu files\n", st->segments);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].type != OUTPUT_TYPE_PIPE) continue;
+        
+        const frame_pipe_stats_t* st = &outputs[i].handle.pipe->stats;
+        if (st->frames == 0) continue;
+        
+        printf("Pipe:\n");
+        printf("  Written:  %lu frames, %.1f MB, %.2f writes per frame\n",
+               st->frames, st->bytes / 1e6, (double)st->writes / st->frames);
+        printf("  Dropped:  %lu frames with the reader behind, %lu larger than the pipe, %lu waits mid-frame\n",
+               st->dropped, st->oversize, st->stalls);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].type != OUTPUT_TYPE_RENDER) continue;
+        
+        const display_renderer_stats_t* st = display_renderer_stats(outputs[i].handle.renderer);
+        if (st->yuv.frames + st->rgb.frames == 0) continue;
+        
+        printf("Render:\n");
+        print_render_path("YUV", &st->yuv);
+        print_render_path("RGB", &st->rgb);
+        printf("  Shown:    %lu frames (%lu decoded but skipped)\n", st->displayed, st->skipped);
+        
+        jpeg_decoder_stats_t dst = jpeg_decoder_stats(decoder);
+        printf("  Decoder:  %u threads for all inputs, %lu frames sliced, %lu failed\n",
+               jpeg_decoder_threads(decoder), dst.sliced, dst.failed);
     }
 }
 
-static void update_profile(uint64_t frame_ts) {
-    if (!profile.enabled) return;
+static void print_receiver_stats(const udp_receiver_t* recv) {
+    if (!profile_enabled || recv->stats.frames == 0) return;
     
-    uint64_t now = udp_get_time_us();
+    const udp_receiver_stats_t* st = &recv->stats;
+    printf("Receive:\n");
+    printf("  Packets:  %.1f per frame\n", (double)st->packets / st->frames);
+    printf("  Syscalls: %.1f per frame\n", (double)st->syscalls / st->frames);
+    printf("  Copies:   %.1f per frame\n", (double)st->copies / st->frames);
+    printf("  Lost:     %lu incomplete frames\n", st->incomplete);
+    printf("  Stale:    %lu packets\n", st->stale);
+    printf("  Rebuilt:  %lu segments\n", st->recovered);
+    if (st->nacks > 0) printf("  NACKs:    %lu sent\n", st->nacks);
     
-    if (profile.frame_count == 0) {
-        profile.first_frame_time = now;
-        profile.min_latency = UINT64_MAX;
+    const clock_sync_t* cs = &recv->clock;
+    if (recv->clock_enabled && cs->valid) {
+        printf("Clock:\n");
+        printf("  Offset:   %+.3f ms (+/- %.3f ms)\n", cs->offset_us / 1000.0, cs->delay_us / 2000.0);
+        printf("  Drift:    %+.1f ppm\n", cs->drift * 1e6);
+        printf("  Samples:  %lu\n", cs->samples);
+    } else if (recv->clock_enabled) {
+        printf("Clock:      no replies from sender\n");
     }
+}
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Intervals use the monotonic clock so a wall clock step cannot turn into
+ * a huge interval; latency has to compare against the wall clock stamps. */
+static void update_profile(profile_stats_t* profile, uint64_t frame_ts) {
+    if (!profile_enabled) return;
     
-    profile.last_frame_time = now;
-    profile.frame_count++;
+    uint64_t now = mono_us();
     
-    if (frame_ts > 0 && now > frame_ts) {
-        uint64_t latency = now - frame_ts;
-        profile.total_latency += latency;
-        if (latency < profile.min_latency) profile.min_latency = latency;
-        if (latency > profile.max_latency) profile.max_latency = latency;
+    if (profile->frame_count == 0) {
+        profile->first_frame_time = now;
+    } else {
+        latency_histogram_record(&profile->interval, now - profile->last_frame_time);
+    }
+    
+    profile->last_frame_time = now;
+    profile->frame_count++;
+    
+    uint64_t wall = udp_get_time_us();
+    if (frame_ts > 0 && wall > frame_ts) {
+        latency_histogram_record(&profile->latency, wall - frame_ts);
     }
 }
 
-static bool check_renderer_open(output_slot_t* outputs, int count) {
-    for (int i = 0; i < count; i++) {
-        if (outputs[i].type == OUTPUT_TYPE_RENDER) {
-            if (!display_renderer_is_open(outputs[i].handle.renderer)) {
+static bool check_renderer_open(pipeline_t* pls, int count) {
+    for (int p = 0; p < count; p++) {
+        for (int i = 0; i < pls[p].output_count; i++) {
+            output_slot_t* out = &pls[p].outputs[i];
+            if (out->type == OUTPUT_TYPE_RENDER && !display_renderer_is_open(out->handle.renderer)) {
                 return false;
             }
         }
@@ -122,24 +468,401 @@ static bool check_renderer_open(output_slot_t* outputs, int count) {
     return true;
 }
 
-static void process_outputs(output_slot_t* outputs, int count, uint64_t ts,
+static uint64_t trace_now(void) {
+    return trace ? udp_get_time_us() : 0;
+}
+
+static void notify_render(void) {
+    pthread_mutex_lock(&render_lock);
+    render_seq++;
+    pthread_cond_signal(&render_ready);
+    pthread_mutex_unlock(&render_lock);
+}
+
+static uint64_t wait_render(uint64_t seen, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    
+    pthread_mutex_lock(&render_lock);
+    while (render_seq == seen) {
+        if (pthread_cond_timedwait(&render_ready, &render_lock, &deadline) == ETIMEDOUT) break;
+    }
+    seen = render_seq;
+    pthread_mutex_unlock(&render_lock);
+    return seen;
+}
+
+static void deliver_output(output_slot_t* out, const frame_ref_t* frame) {
+    uint64_t start = trace_now();
+    frame_trace_span(trace, out->trace_track, "queue", frame->timestamp_us,
+                     frame->stage_us[FRAME_STAGE_READY], start);
+    
+    switch (out->type) {
+        case OUTPUT_TYPE_SEND:
+            udp_sender_transmit(out->handle.sender, frame->timestamp_us, frame->data, frame->len, out->send_rounds);
+            break;
+        case OUTPUT_TYPE_RECORD:
+            frame_recorder_write(out->handle.recorder, frame->timestamp_us, frame->data, frame->len);
+            break;
+        case OUTPUT_TYPE_PIPE:
+            if (!out->handle.pipe->broken &&
+                frame_pipe_write(out->handle.pipe, frame->timestamp_us, frame->data, frame->len) < 0) {
+                fprintf(stderr, "Pipe output on fd %d failed or its reader stalled, stopping it\n",
+                        out->handle.pipe->fd);
+            }
+            break;
+    }
+    
+    frame_trace_span(trace, out->trace_track, output_type_name(out->type), frame->timestamp_us,
+                     start, trace_now());
+}
+
+static void* output_worker(void* arg) {
+    output_slot_t* out = arg;
+    
+    frame_ref_t* frame;
+    while ((frame = frame_queue_pop(out->queue, -1)) != NULL) {
+        deliver_output(out, frame);
+        frame_ref_release(frame);
+    }
+    
+    return NULL;
+}
+
+static void trace_input(const pipeline_t* pl, const frame_ref_t* frame) {
+    const uint64_t* st = frame->stage_us;
+    uint64_t ts = frame->timestamp_us;
+    uint32_t track = pl->trace_track;
+    
+    if (st[FRAME_STAGE_DQBUF]) {
+        frame_trace_span(trace, track, "capture", ts, st[FRAME_STAGE_CAPTURE], st[FRAME_STAGE_DQBUF]);
+        frame_trace_span(trace, track, "copy", ts, st[FRAME_STAGE_DQBUF], st[FRAME_STAGE_READY]);
+        return;
+    }
+    
+    /* testsrc and replay frames are only copied into the ring */
+    if (!st[FRAME_STAGE_FIRST_PACKET]) {
+        frame_trace_span(trace, track, "copy", ts, st[FRAME_STAGE_CAPTURE], st[FRAME_STAGE_READY]);
+        return;
+    }
+    
+    frame_trace_span(trace, track, "network", ts, st[FRAME_STAGE_CAPTURE], st[FRAME_STAGE_FIRST_PACKET]);
+    frame_trace_span(trace, track, "receive", ts, st[FRAME_STAGE_FIRST_PACKET], st[FRAME_STAGE_LAST_PACKET]);
+    frame_trace_span(trace, track, "reassemble", ts, st[FRAME_STAGE_LAST_PACKET], st[FRAME_STAGE_COMPLETE]);
+    frame_trace_span(trace, track, "copy", ts, st[FRAME_STAGE_COMPLETE], st[FRAME_STAGE_READY]);
+}
+
+static void show_decoded(void* ctx, jpeg_image_t* image) {
+    decode_target_t* target = ctx;
+    pipeline_t* pl = target->pl;
+    
+    if (trace) {
+        uint64_t end = trace_now();
+        frame_trace_span(trace, TRACE_DECODER_TRACK + image->worker, "decode", image->timestamp_us,
+                         end - image->decode_us, end);
+    }
+    
+    for (int i = 0; i < pl->output_count; i++) {
+        output_slot_t* out = &pl->outputs[i];
+        if (out->type != OUTPUT_TYPE_RENDER) continue;
+        if (display_renderer_decode_format(out->handle.renderer) != target->format) continue;
+        display_renderer_show(out->handle.renderer, image);
+    }
+    
+    notify_render();
+}
+
+/* Each frame is decoded once per pixel format its render outputs want, on
+ * the shared decoder threads, and the image is shown by all of them. */
+static void submit_decode(pipeline_t* pl, frame_ref_t* frame) {
+    bool wanted[2] = { false, false };
+    for (int i = 0; i < pl->output_count; i++) {
+        if (pl->outputs[i].type != OUTPUT_TYPE_RENDER) continue;
+        wanted[display_renderer_decode_format(pl->outputs[i].handle.renderer)] = true;
+    }
+    
+    for (int format = 0; format < 2; format++) {
+        if (!wanted[format]) continue;
+        
+        decode_target_t* target = &pl->decode_targets[format];
+        if (jpeg_decoder_submit(decoder, frame, format, show_decoded, target) != 0) {
+            target->dropped++;
+        }
+    }
+}
+
+static void publish_frame(pipeline_t* pl, frame_ref_t* frame, uint64_t ts, const uint64_t* stage_us) {
+    frame->timestamp_us = ts;
+    memcpy(frame->stage_us, stage_us, sizeof(frame->stage_us));
+    frame->stage_us[FRAME_STAGE_READY] = trace_now();
+    if (trace) trace_input(pl, frame);
+    
+    bool render = false;
+    for (int i = 0; i < pl->output_count; i++) {
+        output_slot_t* out = &pl->outputs[i];
+        if (out->type == OUTPUT_TYPE_RENDER) {
+            render = true;
+        } else if (pl->wait_outputs) {
+            while (running && frame_queue_push_wait(out->queue, frame, REPLAY_POLL_MS) > 0) {}
+        } else {
+            frame_queue_push(out->queue, frame);
+        }
+    }
+    
+    if (render) submit_decode(pl, frame);
+    frame_ref_release(frame);
+}
+
+static int process_outputs(pipeline_t* pl, uint64_t ts, const uint64_t* stage_us,
                            const void* jpeg, size_t jpeg_len) {
+    frame_ref_t* frame = frame_ring_acquire(pl->ring);
+    if (!frame) {
+        pl->ring_full++;
+        return -1;
+    }
+    
+    if (frame_ref_reserve(frame, jpeg_len) < 0) {
+        frame_ref_release(frame);
+        pl->oversize++;
+        return -1;
+    }
+    
+    memcpy(frame->data, jpeg, jpeg_len);
+    frame->len = jpeg_len;
+    publish_frame(pl, frame, ts, stage_us);
+    return 0;
+}
+
+/* Capture buffers are lent to the outputs without a copy while enough stay
+ * queued for the driver to keep filling; past that frames are copied into
+ * the frame ring and the buffer goes straight back. */
+static bool lend_capture_buffer(pipeline_t* pl, capture_buffer_t* buf, const uint64_t* stage_us) {
+    if (video_capturer_queued(pl->cap) < CAPTURE_SPARE_BUFFERS) return false;
+    
+    frame_ref_t* frame = frame_ring_acquire(pl->borrowed);
+    if (!frame) return false;
+    
+    frame->data = buf->data;
+    frame->capacity = buf->length;
+    frame->len = buf->used;
+    frame->opaque = buf;
+    publish_frame(pl, frame, buf->timestamp_us, stage_us);
+    return true;
+}
+
+static void requeue_capture_buffer(void* ctx, frame_ref_t* frame) {
+    video_capturer_requeue(ctx, frame->opaque);
+}
+
+static uint32_t output_queue_depth(const output_slot_t* out) {
+    if (out->queue_depth > 0) return out->queue_depth;
+    
+    switch (out->type) {
+        case OUTPUT_TYPE_RECORD: return RECORD_QUEUE_DEPTH;
+        case OUTPUT_TYPE_PIPE: return PIPE_QUEUE_DEPTH;
+    }
+    return 1;
+}
+
+static int output_queue_policy(int type) {
+    switch (type) {
+        case OUTPUT_TYPE_RECORD:
+            return FRAME_POLICY_SPILL;
+        case OUTPUT_TYPE_PIPE:
+            return FRAME_POLICY_QUEUE;
+    }
+    return FRAME_POLICY_LATEST;
+}
+
+static uint32_t ring_slots_needed(output_slot_t* outputs, int count) {
+    uint32_t slots = 1;
     for (int i = 0; i < count; i++) {
-        switch (outputs[i].type) {
-            case OUTPUT_TYPE_SEND:
-                udp_sender_transmit(outputs[i].handle.sender, ts, jpeg, jpeg_len, outputs[i].send_rounds);
-                break;
-            case OUTPUT_TYPE_RECORD:
-                frame_recorder_write(outputs[i].handle.recorder, ts, jpeg, jpeg_len);
-                break;
-            case OUTPUT_TYPE_PIPE:
-                frame_pipe_write(outputs[i].handle.pipe, ts, jpeg, jpeg_len);
-                break;
-            case OUTPUT_TYPE_RENDER:
-                display_renderer_render(outputs[i].handle.renderer, jpeg, jpeg_len);
-                break;
+        if (outputs[i].type == OUTPUT_TYPE_RENDER) slots += jpeg_decoder_capacity(decoder);
+        else slots += output_queue_depth(&outputs[i]) + 1;
+    }
+    return slots;
+}
+
+/* Render outputs have no queue or worker of their own: their frames go to
+ * the shared decoder. */
+static int start_outputs(pipeline_t* pl) {
+    output_slot_t* outputs = pl->outputs;
+    for (int i = 0; i < pl->output_count; i++) {
+        outputs[i].trace_track = pl->trace_track + 1 + i;
+        if (trace) {
+            char name[96];
+            snprintf(name, sizeof(name), "%s %d %s", pl->name, i + 1, output_type_name(outputs[i].type));
+            frame_trace_name_track(trace, outputs[i].trace_track, name);
+        }
+        
+        if (outputs[i].type == OUTPUT_TYPE_RENDER) continue;
+        
+        outputs[i].queue = frame_queue_create(output_queue_depth(&outputs[i]),
+                                              output_queue_policy(outputs[i].type));
+        if (!outputs[i].queue) return -1;
+        if (outputs[i].type == OUTPUT_TYPE_RECORD) {
+            frame_queue_set_spill(outputs[i].queue, (size_t)outputs[i].spill_mb * 1000000);
+        }
+        
+        if (pthread_create(&outputs[i].worker, NULL, output_worker, &outputs[i]) != 0) return -1;
+        outputs[i].worker_started = true;
+    }
+    return 0;
+}
+
+static void stop_outputs(output_slot_t* outputs, int count) {
+    for (int i = 0; i < count; i++) {
+        frame_queue_close(outputs[i].queue);
+        if (outputs[i].type == OUTPUT_TYPE_PIPE) frame_pipe_close(outputs[i].handle.pipe);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].worker_started) {
+            pthread_join(outputs[i].worker, NULL);
+            outputs[i].worker_started = false;
+        }
+    }
+}
+
+static bool has_render_output(output_slot_t* outputs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (outputs[i].type == OUTPUT_TYPE_RENDER) return true;
+    }
+    return false;
+}
+
+/* Frames are decoded on the decoder threads; this thread only uploads and
+ * presents the newest decoded frame, so a present blocked on vsync delays
+ * neither decoding nor the input loop. */
+static void render_loop(pipeline_t* pls, int count) {
+    uint64_t seen = 0;
+    
+    while (running && check_renderer_open(pls, count)) {
+        seen = wait_render(seen, RENDER_POLL_MS);
+        
+        for (int p = 0; p < count; p++) {
+            for (int i = 0; i < pls[p].output_count; i++) {
+                output_slot_t* out = &pls[p].outputs[i];
+                if (out->type != OUTPUT_TYPE_RENDER) continue;
+                
+                uint64_t ts;
+                uint64_t start = trace_now();
+                if (display_renderer_present(out->handle.renderer, &ts) > 0) {
+                    frame_trace_span(trace, out->trace_track, "present", ts, start, trace_now());
+                }
+            }
+        }
+    }
+}
+
+static void init_pipeline(pipeline_t* pl, const char* name, uint32_t index) {
+    memset(pl, 0, sizeof(*pl));
+    snprintf(pl->name, sizeof(pl->name), "%s", name);
+    pl->trace_track = index * TRACE_TRACKS_PER_INPUT;
+    for (int format = 0; format < 2; format++) {
+        pl->decode_targets[format].pl = pl;
+        pl->decode_targets[format].format = format;
+    }
+    latency_histogram_reset(&pl->profile.latency);
+    latency_histogram_reset(&pl->profile.interval);
+}
+
+/* One decoder serves the render outputs of every input. By default it runs
+ * two threads per render output, up to the number of CPUs. */
+static int start_decoder(pipeline_t* pls, int count) {
+    uint32_t renders = 0;
+    uint32_t max_width = 0;
+    uint32_t max_height = 0;
+    
+    for (int p = 0; p < count; p++) {
+        for (int i = 0; i < pls[p].output_count; i++) {
+            if (pls[p].outputs[i].type != OUTPUT_TYPE_RENDER) continue;
+            renders++;
+            if (pls[p].width > max_width) max_width = pls[p].width;
+            if (pls[p].height > max_height) max_height = pls[p].height;
         }
     }
+    if (renders == 0) return 0;
+    
+    uint32_t threads = decoder_threads;
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = renders * 2;
+        if (cpus > 0 && threads > (uint32_t)cpus) threads = cpus;
+    }
+    if (threads > JPEG_DECODER_MAX_THREADS) threads = JPEG_DECODER_MAX_THREADS;
+    
+    decoder = jpeg_decoder_create(threads, threads * 2 + renders * 2 + 1, max_width, max_height);
+    if (!decoder) {
+        fprintf(stderr, "Failed to start JPEG decoder\n");
+        return -1;
+    }
+    if (decoder_slices > 0 && jpeg_decoder_set_slices(decoder, decoder_slices) < 0) {
+        fprintf(stderr, "Invalid slice count: %u\n", decoder_slices);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; trace && i < threads; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "decoder %u", i + 1);
+        frame_trace_name_track(trace, TRACE_DECODER_TRACK + i, name);
+    }
+    return 0;
+}
+
+static int start_pipeline(pipeline_t* pl, size_t max_frame_size) {
+    pl->ring = frame_ring_create(ring_slots_needed(pl->outputs, pl->output_count), max_frame_size);
+    if (!pl->ring) {
+        fprintf(stderr, "Failed to allocate frame ring\n");
+        return -1;
+    }
+    
+    frame_trace_name_track(trace, pl->trace_track, pl->name);
+    
+    if (start_outputs(pl) < 0) {
+        fprintf(stderr, "Failed to start output workers\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* The input loop runs on this thread unless something renders, in which
+ * case rendering keeps the main thread as SDL requires. */
+static int run_inputs(pipeline_t* pls, int count, void* (*input_loop)(void*), void* arg) {
+    bool render = false;
+    for (int i = 0; i < count; i++) {
+        if (has_render_output(pls[i].outputs, pls[i].output_count)) render = true;
+    }
+    
+    if (!render) {
+        input_loop(arg);
+        return 0;
+    }
+    
+    pthread_t input_thread;
+    if (pthread_create(&input_thread, NULL, input_loop, arg) != 0) {
+        fprintf(stderr, "Failed to start input thread\n");
+        return -1;
+    }
+    
+    render_loop(pls, count);
+    running = false;
+    pthread_join(input_thread, NULL);
+    return 0;
+}
+
+static void release_pipeline(pipeline_t* pl) {
+    for (int i = 0; i < pl->output_count; i++) {
+        frame_queue_destroy(pl->outputs[i].queue);
+        pl->outputs[i].queue = NULL;
+    }
+    frame_ring_destroy(pl->ring);
+    pl->ring = NULL;
+    frame_ring_destroy(pl->borrowed);
+    pl->borrowed = NULL;
 }
 
 static void cleanup_outputs(output_slot_t* outputs, int count) {
@@ -161,6 +884,195 @@ static void cleanup_outputs(output_slot_t* outputs, int count) {
     }
 }
 
+static bool is_option(const char* arg) {
+    return strchr(arg, '=') != NULL;
+}
+
+static const char* option_value(const char* arg, const char* key) {
+    size_t key_len = strlen(key);
+    if (strncmp(arg, key, key_len) != 0 || arg[key_len] != '=') return NULL;
+    return arg + key_len + 1;
+}
+
+static int parse_send_option(const char* arg, send_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "tx")) != NULL) {
+        if (strcmp(val, "copy") == 0) opts->tx_mode = UDP_TX_COPY;
+        else if (strcmp(val, "mmsg") == 0) opts->tx_mode = UDP_TX_MMSG;
+        else if (strcmp(val, "gso") == 0) opts->tx_mode = UDP_TX_GSO;
+        else return -1;
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "zerocopy")) != NULL) {
+        opts->zerocopy_threshold = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "fec")) != NULL) {
+        opts->fec_k = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "nack")) != NULL) {
+        opts->nack_deadline_ms = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "clock")) != NULL) {
+        opts->clock_sync = atoi(val) != 0;
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "pace")) != NULL) {
+        opts->pace_mbps = atof(val);
+        return opts->pace_mbps < 0 ? -1 : 0;
+    }
+    
+    if ((val = option_value(arg, "burst")) != NULL) {
+        opts->burst_bytes = atoi(val);
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int parse_capture_option(const char* arg, capture_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "buffers")) != NULL) {
+        opts->buffer_count = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "latest")) != NULL) {
+        opts->latest_only = atoi(val) != 0;
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int parse_receive_option(const char* arg, receive_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "rx")) != NULL) {
+        if (strcmp(val, "recvfrom") == 0) opts->rx_mode = UDP_RX_RECVFROM;
+        else if (strcmp(val, "mmsg") == 0) opts->rx_mode = UDP_RX_MMSG;
+        else if (strcmp(val, "gro") == 0) opts->rx_mode = UDP_RX_GRO;
+        else return -1;
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "batch")) != NULL) {
+        opts->batch_size = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "slots")) != NULL) {
+        opts->slot_count = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "deadline")) != NULL) {
+        opts->deadline_ms = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "nack")) != NULL) {
+        opts->nack_interval_ms = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "clock")) != NULL) {
+        opts->clock_sync = atoi(val) != 0;
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int parse_replay_option(const char* arg, replay_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "speed")) != NULL) {
+        opts->speed = strcmp(val, "max") == 0 ? 0 : atof(val);
+        return (opts->speed > 0 || strcmp(val, "max") == 0) ? 0 : -1;
+    }
+    
+    if ((val = option_value(arg, "loop")) != NULL) {
+        opts->loops = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "start")) != NULL) {
+        opts->start_s = atof(val);
+        return opts->start_s >= 0 ? 0 : -1;
+    }
+    
+    return -1;
+}
+
+static int parse_testsrc_option(const char* arg, testsrc_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "frames")) != NULL) {
+        opts->frames = atoi(val);
+        return opts->frames > 0 ? 0 : -1;
+    }
+    
+    if ((val = option_value(arg, "count")) != NULL) {
+        opts->count = strtoull(val, NULL, 10);
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int parse_record_option(const char* arg, record_options_t* opts) {
+    const char* val;
+    
+    if ((val = option_value(arg, "queue")) != NULL) {
+        opts->queue_depth = atoi(val);
+        return opts->queue_depth > 0 ? 0 : -1;
+    }
+    
+    if ((val = option_value(arg, "spill")) != NULL) {
+        opts->spill_mb = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "sync")) != NULL) {
+        opts->sync_ms = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "segment")) != NULL) {
+        opts->segment_s = atoi(val);
+        return 0;
+    }
+    
+    if ((val = option_value(arg, "segment_mb")) != NULL) {
+        opts->segment_mb = atoi(val);
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int parse_render_option(const char* arg, display_renderer_t* disp) {
+    const char* val;
+    
+    if ((val = option_value(arg, "decode")) != NULL) {
+        if (strcmp(val, "yuv") == 0) return display_renderer_set_decode(disp, JPEG_DECODE_YUV);
+        if (strcmp(val, "rgb") == 0) return display_renderer_set_decode(disp, JPEG_DECODE_RGB);
+        return -1;
+    }
+    
+    return -1;
+}
+
 static int parse_outputs(int argc, char** argv, int start_arg, output_slot_t* outputs,
                         int* out_count, uint32_t width, uint32_t height,
                         uint32_t fps_num, uint32_t fps_den, const char* window_title) {
@@ -171,6 +1083,8 @@ static int parse_outputs(int argc, char** argv, int start_arg, output_slot_t* ou
     (void)fps_den;
     
     while (next_arg < argc && count < MAX_OUTPUTS) {
+        if (strcmp(argv[next_arg], "capture") == 0) break;
+        
         if (strcmp(argv[next_arg], "send") == 0) {
             if (argc < next_arg + 8) {
                 fprintf(stderr, "send requires: LOCAL_IP LOCAL_PORT REMOTE_IP REMOTE_PORT PACKET_LEN JPEG_LEN ROUNDS\n");
@@ -193,35 +1107,88 @@ static int parse_outputs(int argc, char** argv, int start_arg, output_slot_t* ou
             count++;
             next_arg += 8;
             
+            send_options_t opts = { .tx_mode = UDP_TX_COPY, .zerocopy_threshold = UDP_SENDER_ZEROCOPY_DEFAULT };
+            while (next_arg < argc && is_option(argv[next_arg])) {
+                if (parse_send_option(argv[next_arg], &opts) < 0) {
+                    fprintf(stderr, "Invalid send option: %s\n", argv[next_arg]);
+                    *out_count = count;
+                    return -1;
+                }
+                next_arg++;
+            }
+            
+            if (udp_sender_set_tx_mode(sender, opts.tx_mode, opts.zerocopy_threshold) < 0) {
+                fprintf(stderr, "Failed to configure sender transmit mode\n");
+                *out_count = count;
+                return -1;
+            }
+            
+            if (udp_sender_set_fec(sender, opts.fec_k) < 0) {
+                fprintf(stderr, "fec group size must be 0-%d\n", UDP_FEC_MAX_K);
+                *out_count = count;
+                return -1;
+            }
+            
+            if (udp_sender_set_nack(sender, opts.nack_deadline_ms) < 0) {
+                fprintf(stderr, "Failed to start NACK feedback\n");
+                *out_count = count;
+                return -1;
+            }
+            
+            if (udp_sender_set_clock_sync(sender, opts.clock_sync) < 0) {
+                fprintf(stderr, "Failed to start clock feedback\n");
+                *out_count = count;
+                return -1;
+            }
+            
+            udp_sender_set_pacing(sender, (uint64_t)(opts.pace_mbps * 1e6), opts.burst_bytes);
+            
         } else if (strcmp(argv[next_arg], "record") == 0) {
             if (argc < next_arg + 2) {
                 fprintf(stderr, "record requires: FILENAME\n");
                 return -1;
             }
             
-            frame_recorder_t* rec = frame_recorder_create(
-                argv[next_arg + 1], width, height, fps_num, fps_den);
+            const char* filename = argv[next_arg + 1];
+            next_arg += 2;
+            
+            record_options_t opts = { .queue_depth = RECORD_QUEUE_DEPTH, .spill_mb = RECORD_SPILL_MB,
+                                      .sync_ms = FRAME_RECORDER_SYNC_DEFAULT_MS };
+            while (next_arg < argc && is_option(argv[next_arg])) {
+                if (parse_record_option(argv[next_arg], &opts) < 0) {
+                    fprintf(stderr, "Invalid record option: %s\n", argv[next_arg]);
+                    *out_count = count;
+                    return -1;
+                }
+                next_arg++;
+            }
+            
+            frame_recorder_t* rec = frame_recorder_create_segmented(
+                filename, width, height, fps_num, fps_den,
+                opts.segment_s, (uint64_t)opts.segment_mb * 1000000);
             
             if (!rec) {
-                fprintf(stderr, "Failed to create recorder: %s\n", argv[next_arg + 1]);
+                fprintf(stderr, "Failed to create recorder: %s\n", filename);
                 return -1;
             }
+            frame_recorder_set_sync(rec, opts.sync_ms);
             
             outputs[count].type = OUTPUT_TYPE_RECORD;
             outputs[count].handle.recorder = rec;
+            outputs[count].queue_depth = opts.queue_depth;
+            outputs[count].spill_mb = opts.spill_mb;
             count++;
-            next_arg += 2;
             
         } else if (strcmp(argv[next_arg], "pipe") == 0) {
             if (argc < next_arg + 3) {
-                fprintf(stderr, "pipe requires: FD CHUNK_SIZE\n");
+                fprintf(stderr, "pipe requires: FD PIPE_SIZE\n");
                 return -1;
             }
             
             int fd = atoi(argv[next_arg + 1]);
-            uint32_t chunk = atoi(argv[next_arg + 2]);
+            uint32_t pipe_size = atoi(argv[next_arg + 2]);
             
-            frame_pipe_t* pipe = frame_pipe_create(fd, chunk);
+            frame_pipe_t* pipe = frame_pipe_create(fd, pipe_size);
             if (!pipe) {
                 fprintf(stderr, "Failed to create pipe\n");
                 return -1;
@@ -252,6 +1219,15 @@ static int parse_outputs(int argc, char** argv, int start_arg, output_slot_t* ou
             count++;
             next_arg += 3;
             
+            while (next_arg < argc && is_option(argv[next_arg])) {
+                if (parse_render_option(argv[next_arg], disp) < 0) {
+                    fprintf(stderr, "Invalid render option: %s\n", argv[next_arg]);
+                    *out_count = count;
+                    return -1;
+                }
+                next_arg++;
+            }
+            
         } else {
             fprintf(stderr, "Unknown output: %s\n", argv[next_arg]);
             return -1;
@@ -259,13 +1235,119 @@ static int parse_outputs(int argc, char** argv, int start_arg, output_slot_t* ou
     }
     
     *out_count = count;
+    if (next_arg < argc && count == MAX_OUTPUTS && strcmp(argv[next_arg], "capture") != 0) {
+        fprintf(stderr, "At most %d outputs per input supported\n", MAX_OUTPUTS);
+        return -1;
+    }
     return next_arg;
 }
 
-static int run_capture_pipeline(int argc, char** argv, int arg_start) {
+static void capture_frame(pipeline_t* pl, capture_buffer_t* buf) {
+    uint64_t stage_us[FRAME_STAGE_COUNT] = {0};
+    stage_us[FRAME_STAGE_CAPTURE] = buf->timestamp_us;
+    stage_us[FRAME_STAGE_DQBUF] = trace_now();
+    
+    update_profile(&pl->profile, buf->timestamp_us);
+    if (!lend_capture_buffer(pl, buf, stage_us)) {
+        process_outputs(pl, buf->timestamp_us, stage_us, buf->data, buf->used);
+        video_capturer_requeue(pl->cap, buf);
+    }
+}
+
+/* Drains every ready frame; false once the device has failed. */
+static bool drain_capture(pipeline_t* pl) {
+    capture_buffer_t* buf;
+    int ret;
+    while ((ret = video_capturer_dequeue(pl->cap, &buf)) > 0) {
+        capture_frame(pl, buf);
+    }
+    return ret == 0;
+}
+
+/* All cameras are served from one thread: each device is non-blocking and
+ * registered with epoll, and a device that fails is dropped while the
+ * others keep running. */
+static void* capture_loop(void* arg) {
+    input_set_t* set = arg;
+    
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        fprintf(stderr, "Failed to create epoll instance\n");
+        running = false;
+        return NULL;
+    }
+    
+    int active = 0;
+    for (int i = 0; i < set->count; i++) {
+        pipeline_t* pl = &set->pipelines[i];
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = pl };
+        if (video_capturer_set_nonblocking(pl->cap, true) < 0 ||
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pl->cap->device_fd, &ev) < 0) {
+            fprintf(stderr, "Failed to poll capture device: %s\n", pl->name);
+            continue;
+        }
+        active++;
+    }
+    
+    struct epoll_event events[MAX_CAPTURES];
+    while (running && active > 0) {
+        int ready = epoll_wait(epoll_fd, events, MAX_CAPTURES, CAPTURE_POLL_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Capture poll failed\n");
+            break;
+        }
+        
+        for (int i = 0; i < ready; i++) {
+            pipeline_t* pl = events[i].data.ptr;
+            if (drain_capture(pl)) continue;
+            
+            fprintf(stderr, "Frame capture failed: %s\n", pl->name);
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pl->cap->device_fd, NULL);
+            active--;
+        }
+    }
+    
+    close(epoll_fd);
+    running = false;
+    return NULL;
+}
+
+static void* receive_loop(void* arg) {
+    pipeline_t* pl = arg;
+    udp_receiver_t* recv = pl->recv;
+    
+    while (running) {
+        if (!udp_receiver_get_frame(recv)) break;
+        
+        uint64_t captured_us = udp_receiver_local_time(recv, recv->frame_ts_us);
+        uint64_t stage_us[FRAME_STAGE_COUNT] = {0};
+        stage_us[FRAME_STAGE_CAPTURE] = captured_us;
+        stage_us[FRAME_STAGE_FIRST_PACKET] = recv->frame_first_us;
+        stage_us[FRAME_STAGE_LAST_PACKET] = recv->frame_last_us;
+        stage_us[FRAME_STAGE_COMPLETE] = trace_now();
+        
+        update_profile(&pl->profile, captured_us);
+        process_outputs(pl, recv->frame_ts_us, stage_us, recv->frame_buf, recv->frame_len);
+    }
+    
+    running = false;
+    return NULL;
+}
+
+static void close_capture(pipeline_t* pl) {
+    release_pipeline(pl);
+    cleanup_outputs(pl->outputs, pl->output_count);
+    video_capturer_destroy(pl->cap);
+    pl->cap = NULL;
+}
+
+/* Opens one capture input and its outputs, returning the index of the next
+ * argument or -1; the pipeline is left for close_capture() either way. */
+static int open_capture(pipeline_t* pl, uint32_t index, int argc, char** argv, int arg_start) {
     if (argc < arg_start + 5) {
         fprintf(stderr, "capture requires: DEVICE WIDTH HEIGHT FPS_NUM FPS_DEN\n");
-        return 1;
+        return -1;
     }
     
     const char* device = argv[arg_start];
@@ -274,50 +1356,112 @@ static int run_capture_pipeline(int argc, char** argv, int arg_start) {
     uint32_t fps_num = atoi(argv[arg_start + 3]);
     uint32_t fps_den = atoi(argv[arg_start + 4]);
     
-    video_capturer_t* cap = video_capturer_create(device, width, height, fps_num, fps_den);
+    init_pipeline(pl, device, index);
+    pl->width = width;
+    pl->height = height;
+    
+    int next_arg = arg_start + 5;
+    capture_options_t opts = { .buffer_count = CAPTURER_BUFFER_COUNT_DEFAULT };
+    while (next_arg < argc && is_option(argv[next_arg])) {
+        if (parse_capture_option(argv[next_arg], &opts) < 0) {
+            fprintf(stderr, "Invalid capture option: %s\n", argv[next_arg]);
+            return -1;
+        }
+        next_arg++;
+    }
+    
+    video_capturer_t* cap = video_capturer_create(device, width, height, fps_num, fps_den, opts.buffer_count);
     if (!cap) {
         fprintf(stderr, "Failed to open capture device: %s\n", device);
-        return 1;
+        return -1;
     }
+    pl->cap = cap;
+    video_capturer_set_latest_only(cap, opts.latest_only);
     
     char title[256];
     snprintf(title, sizeof(title), "mjpgo - %s %ux%u", device, width, height);
     
-    output_slot_t outputs[MAX_OUTPUTS];
-    int output_count = 0;
-    memset(outputs, 0, sizeof(outputs));
+    next_arg = parse_outputs(argc, argv, next_arg, pl->outputs, &pl->output_count,
+                             width, height, fps_num, fps_den, title);
+    if (next_arg < 0) return -1;
     
-    if (parse_outputs(argc, argv, arg_start + 5, outputs, &output_count,
-                     width, height, fps_num, fps_den, title) < 0) {
-        video_capturer_destroy(cap);
-        cleanup_outputs(outputs, output_count);
-        return 1;
+    if (pl->output_count == 0) {
+        fprintf(stderr, "At least one output required for %s\n", device);
+        return -1;
     }
     
-    if (output_count == 0) {
-        fprintf(stderr, "At least one output required\n");
-        video_capturer_destroy(cap);
-        return 1;
+    printf("Capturing from %s at %ux%u [%u/%u], %u buffers\n", device, width, height,
+           fps_num, fps_den, cap->buffer_count);
+    
+    pl->borrowed = frame_ring_create_borrowed(cap->buffer_count, requeue_capture_buffer, cap);
+    if (!pl->borrowed) {
+        fprintf(stderr, "Failed to allocate frame ring\n");
+        return -1;
     }
     
-    printf("Capturing from %s at %ux%u [%u/%u]\n", device, width, height, fps_num, fps_den);
+    return next_arg;
+}
+
+static size_t capture_frame_size(const video_capturer_t* cap) {
+    size_t max_frame_size = 0;
+    for (uint32_t i = 0; i < cap->buffer_count; i++) {
+        if (cap->buffers[i].length > max_frame_size) max_frame_size = cap->buffers[i].length;
+    }
+    return max_frame_size;
+}
+
+static int run_capture_pipeline(int argc, char** argv, int arg_start) {
+    pipeline_t* pls = calloc(MAX_CAPTURES, sizeof(pipeline_t));
+    if (!pls) return 1;
     
-    while (running && check_renderer_open(outputs, output_count)) {
-        if (video_capturer_grab_frame(cap) < 0) {
-            fprintf(stderr, "Frame capture failed\n");
+    int count = 0;
+    int result = 0;
+    int next_arg = arg_start;
+    while (result == 0) {
+        if (count == MAX_CAPTURES) {
+            fprintf(stderr, "At most %d capture inputs supported\n", MAX_CAPTURES);
+            result = -1;
             break;
         }
         
-        capture_buffer_t* buf = &cap->buffers[cap->active_index];
-        update_profile(buf->timestamp_us);
-        process_outputs(outputs, output_count, buf->timestamp_us, buf->data, buf->used);
-        video_capturer_release_frame(cap);
+        next_arg = open_capture(&pls[count], count, argc, argv, next_arg);
+        count++;
+        if (next_arg < 0) {
+            result = -1;
+        } else if (next_arg >= argc) {
+            break;
+        } else if (strcmp(argv[next_arg], "capture") == 0) {
+            next_arg++;
+        } else {
+            fprintf(stderr, "Unknown output: %s\n", argv[next_arg]);
+            result = -1;
+        }
     }
     
-    cleanup_outputs(outputs, output_count);
-    video_capturer_destroy(cap);
-    print_profile_stats();
-    return 0;
+    if (result == 0) result = start_decoder(pls, count);
+    for (int i = 0; i < count && result == 0; i++) {
+        result = start_pipeline(&pls[i], capture_frame_size(pls[i].cap));
+    }
+    
+    if (result == 0) {
+        input_set_t set = { .pipelines = pls, .count = count };
+        result = run_inputs(pls, count, capture_loop, &set);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        stop_outputs(pls[i].outputs, pls[i].output_count);
+    }
+    jpeg_decoder_close(decoder);
+    
+    for (int i = 0; i < count; i++) {
+        print_profile_stats(&pls[i]);
+        close_capture(&pls[i]);
+    }
+    
+    jpeg_decoder_destroy(decoder);
+    decoder = NULL;
+    free(pls);
+    return result < 0 ? 1 : 0;
 }
 
 static int run_receive_pipeline(int argc, char** argv, int arg_start) {
@@ -341,33 +1485,462 @@ static int run_receive_pipeline(int argc, char** argv, int arg_start) {
         return 1;
     }
     
+    int next_arg = arg_start + 8;
+    receive_options_t opts = {
+        .rx_mode = UDP_RX_RECVFROM,
+        .batch_size = UDP_RECEIVER_BATCH_DEFAULT,
+        .slot_count = UDP_RECEIVER_SLOTS_DEFAULT,
+        .deadline_ms = UDP_RECEIVER_DEADLINE_DEFAULT_MS,
+    };
+    while (next_arg < argc && is_option(argv[next_arg])) {
+        if (parse_receive_option(argv[next_arg], &opts) < 0) {
+            fprintf(stderr, "Invalid receive option: %s\n", argv[next_arg]);
+            udp_receiver_destroy(recv);
+            return 1;
+        }
+        next_arg++;
+    }
+    
+    if (udp_receiver_set_window(recv, opts.slot_count, opts.deadline_ms) < 0 ||
+        udp_receiver_set_nack(recv, opts.nack_interval_ms) < 0 ||
+        udp_receiver_set_clock_sync(recv, opts.clock_sync) < 0 ||
+        udp_receiver_set_packet_times(recv, trace != NULL) < 0 ||
+        udp_receiver_set_rx_mode(recv, opts.rx_mode, opts.batch_size) < 0) {
+        fprintf(stderr, "Failed to configure receiver mode\n");
+        udp_receiver_destroy(recv);
+        return 1;
+    }
+    
     char title[256];
     snprintf(title, sizeof(title), "mjpgo - %s:%u %ux%u", ip, port, width, height);
     
-    output_slot_t outputs[MAX_OUTPUTS];
-    int output_count = 0;
-    memset(outputs, 0, sizeof(outputs));
+    pipeline_t* pl = malloc(sizeof(*pl));
+    if (!pl) {
+        udp_receiver_destroy(recv);
+        return 1;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s:%u", ip, port);
+    init_pipeline(pl, name, 0);
+    pl->recv = recv;
+    pl->width = width;
+    pl->height = height;
     
-    if (parse_outputs(argc, argv, arg_start + 8, outputs, &output_count,
-                     width, height, fps_num, fps_den, title) < 0) {
+    next_arg = parse_outputs(argc, argv, next_arg, pl->outputs, &pl->output_count,
+                             width, height, fps_num, fps_den, title);
+    if (next_arg >= 0 && next_arg < argc) {
+        fprintf(stderr, "Unknown output: %s\n", argv[next_arg]);
+        next_arg = -1;
+    }
+    if (next_arg < 0) {
+        cleanup_outputs(pl->outputs, pl->output_count);
         udp_receiver_destroy(recv);
-        cleanup_outputs(outputs, output_count);
+        free(pl);
         return 1;
     }
     
     printf("Receiving on %s:%u\n", ip, port);
     
-    while (running && check_renderer_open(outputs, output_count)) {
-        if (!udp_receiver_get_frame(recv)) break;
+    int result = start_decoder(pl, 1);
+    if (result == 0) result = start_pipeline(pl, jpeg_len);
+    if (result == 0) result = run_inputs(pl, 1, receive_loop, pl);
+    stop_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_close(decoder);
+    
+    print_profile_stats(pl);
+    print_receiver_stats(recv);
+    release_pipeline(pl);
+    cleanup_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_destroy(decoder);
+    decoder = NULL;
+    udp_receiver_destroy(recv);
+    free(pl);
+    return result < 0 ? 1 : 0;
+}
+
+static void print_undelivered(const pipeline_t* pl) {
+    if (pl->ring_full > 0) printf(", %lu not delivered with every slot in use", pl->ring_full);
+    if (pl->oversize > 0) printf(", %lu too large for memory", pl->oversize);
+}
+
+/* Sleeps to an absolute deadline so wakeup jitter does not accumulate, in
+ * short steps so a stop request is seen even across long gaps. */
+static void wait_until(uint64_t due_us) {
+    for (uint64_t now = mono_us(); running && now < due_us; now = mono_us()) {
+        uint64_t wake = due_us;
+        if (wake - now > REPLAY_POLL_MS * 1000) wake = now + REPLAY_POLL_MS * 1000;
+        struct timespec ts = { .tv_sec = wake / 1000000, .tv_nsec = (wake % 1000000) * 1000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+}
+
+/* Segment n of a recording made with segment or segment_mb, or the file
+ * itself for segment 0. */
+static int replay_path(const replay_t* rp, uint32_t segment, char* path, size_t size) {
+    if (segment > 0) return frame_recorder_segment_path(rp->filename, segment, ".mkv", path, size);
+    
+    int len = snprintf(path, size, "%s", rp->filename);
+    return (len < 0 || (size_t)len >= size) ? -1 : 0;
+}
+
+/* Where a segment starts on the recording's timeline, from its index. */
+static bool segment_offset(const replay_t* rp, uint32_t segment, uint64_t* offset_us) {
+    char path[PATH_MAX];
+    uint64_t start_us;
+    if (rp->first_start_us == 0 || replay_path(rp, segment, path, sizeof(path)) < 0 ||
+        frame_player_index_start(path, &start_us) < 0 || start_us < rp->first_start_us) {
+        return false;
+    }
+    *offset_us = start_us - rp->first_start_us;
+    return true;
+}
+
+/* Returns 1 with the next segment open, 0 at the end of the set and -1 if
+ * a segment that exists cannot be opened. A segment without an index
+ * follows one frame interval after the last frame. */
+static int next_segment(replay_t* rp) {
+    char path[PATH_MAX];
+    if (rp->segment == 0 || replay_path(rp, rp->segment + 1, path, sizeof(path)) < 0) return 0;
+    if (access(path, F_OK) < 0) return 0;
+    
+    frame_player_t* player = frame_player_create(path);
+    if (!player) return -1;
+    
+    uint64_t offset_us;
+    if (!segment_offset(rp, rp->segment + 1, &offset_us) || offset_us <= rp->last_pts_us) {
+        offset_us = rp->last_pts_us + rp->frame_interval_us;
+    }
+    
+    frame_player_destroy(rp->player);
+    rp->player = player;
+    rp->segment++;
+    rp->pts_offset_us = offset_us;
+    return 1;
+}
+
+/* Positions playback at the start option: in a segment set the segment
+ * is picked from the index starts alone, then seeking within it uses its
+ * index (or cues) rather than reading the frames in between. */
+static int seek_replay(replay_t* rp) {
+    uint64_t target_us = (uint64_t)(rp->opts.start_s * 1e6);
+    uint32_t segment = rp->segment > 0 ? 1 : 0;
+    uint64_t offset_us = 0;
+    uint64_t next_us;
+    while (segment > 0 && target_us > 0 && segment_offset(rp, segment + 1, &next_us) && next_us <= target_us) {
+        segment++;
+        offset_us = next_us;
+    }
+    
+    char path[PATH_MAX];
+    if (replay_path(rp, segment, path, sizeof(path)) < 0) return -1;
+    
+    frame_player_t* player = frame_player_create(path);
+    if (!player) return -1;
+    
+    frame_player_destroy(rp->player);
+    rp->player = player;
+    rp->segment = segment;
+    rp->pts_offset_us = offset_us;
+    rp->last_pts_us = offset_us;
+    return target_us > offset_us ? frame_player_seek(player, target_us - offset_us) : 0;
+}
+
+/* Frames are stamped with the time they are released, as if freshly
+ * captured, so latency downstream is measured from the replay. */
+static void* replay_loop(void* arg) {
+    replay_t* rp = arg;
+    pipeline_t* pl = rp->pl;
+    uint64_t start_us = mono_us();
+    
+    for (uint32_t loop = 0; running && (rp->opts.loops == 0 || loop < rp->opts.loops); loop++) {
+        if ((loop > 0 || rp->opts.start_s > 0) && seek_replay(rp) < 0) {
+            fprintf(stderr, "Failed to seek %s\n", pl->name);
+            break;
+        }
+        
+        uint64_t loop_start = mono_us();
+        uint64_t first_pts = 0;
+        bool first = true;
+        uint64_t pts;
+        const uint8_t* data;
+        size_t len;
+        int ret = 0;
+        
+        while (running) {
+            ret = frame_player_read(rp->player, &pts, &data, &len);
+            if (ret == 0 && (ret = next_segment(rp)) > 0) continue;
+            if (ret <= 0) break;
+            
+            pts += rp->pts_offset_us;
+            rp->last_pts_us = pts;
+            if (first) {
+                first_pts = pts;
+                first = false;
+            }
+            if (rp->opts.speed > 0 && pts > first_pts) {
+                wait_until(loop_start + (uint64_t)((pts - first_pts) / rp->opts.speed));
+            }
+            
+            uint64_t ts = udp_get_time_us();
+            uint64_t stage_us[FRAME_STAGE_COUNT] = {0};
+            stage_us[FRAME_STAGE_CAPTURE] = ts;
+            
+            update_profile(&pl->profile, ts);
+            process_outputs(pl, ts, stage_us, data, len);
+            rp->frames++;
+        }
         
-        update_profile(recv->frame_ts_us);
-        process_outputs(outputs, output_count, recv->frame_ts_us, recv->frame_buf, recv->frame_len);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to read %s\n", pl->name);
+            break;
+        }
     }
     
-    cleanup_outputs(outputs, output_count);
-    udp_receiver_destroy(recv);
-    print_profile_stats();
-    return 0;
+    rp->elapsed_us = mono_us() - start_us;
+    running = false;
+    return NULL;
+}
+
+static int run_replay_pipeline(int argc, char** argv, int arg_start) {
+    if (argc < arg_start + 1) {
+        fprintf(stderr, "replay requires: FILE.mkv\n");
+        return 1;
+    }
+    
+    const char* filename = argv[arg_start];
+    int next_arg = arg_start + 1;
+    
+    replay_t rp = { .opts = { .speed = 1, .loops = 1 } };
+    while (next_arg < argc && is_option(argv[next_arg])) {
+        if (parse_replay_option(argv[next_arg], &rp.opts) < 0) {
+            fprintf(stderr, "Invalid replay option: %s\n", argv[next_arg]);
+            return 1;
+        }
+        next_arg++;
+    }
+    
+    /* "dive.mkv" that was recorded in segments plays dive-0001.mkv onwards. */
+    char path[PATH_MAX];
+    rp.filename = filename;
+    if (access(filename, F_OK) < 0 && replay_path(&rp, 1, path, sizeof(path)) == 0 && access(path, F_OK) == 0) {
+        rp.segment = 1;
+    }
+    
+    if (replay_path(&rp, rp.segment, path, sizeof(path)) == 0) rp.player = frame_player_create(path);
+    if (!rp.player) {
+        fprintf(stderr, "Failed to open MJPEG recording: %s\n", filename);
+        return 1;
+    }
+    
+    const frame_player_info_t* info = frame_player_info(rp.player);
+    rp.first_start_us = info->start_us;
+    rp.frame_interval_us = (uint64_t)info->fps_num * 1000000 / info->fps_den;
+    char title[256];
+    snprintf(title, sizeof(title), "mjpgo - %s %ux%u", filename, info->width, info->height);
+    
+    pipeline_t* pl = malloc(sizeof(*pl));
+    if (!pl) {
+        frame_player_destroy(rp.player);
+        return 1;
+    }
+    init_pipeline(pl, filename, 0);
+    pl->width = info->width;
+    pl->height = info->height;
+    pl->wait_outputs = rp.opts.speed == 0;
+    rp.pl = pl;
+    
+    next_arg = parse_outputs(argc, argv, next_arg, pl->outputs, &pl->output_count,
+                             info->width, info->height, info->fps_num, info->fps_den, title);
+    if (next_arg >= 0 && next_arg < argc) {
+        fprintf(stderr, "Unknown output: %s\n", argv[next_arg]);
+        next_arg = -1;
+    }
+    if (next_arg < 0) {
+        cleanup_outputs(pl->outputs, pl->output_count);
+        frame_player_destroy(rp.player);
+        free(pl);
+        return 1;
+    }
+    
+    printf("Replaying %s%s (%ux%u)\n", filename, rp.segment ? " segments" : "", info->width, info->height);
+    
+    /* Slots start at the raw 4:2:0 frame size, which covers typical camera
+     * JPEGs, and grow for larger frames such as recorded noise. */
+    size_t slot_size = (size_t)info->width * info->height * 3 / 2;
+    
+    int result = start_decoder(pl, 1);
+    if (result == 0) result = start_pipeline(pl, slot_size);
+    if (result == 0) result = run_inputs(pl, 1, replay_loop, &rp);
+    stop_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_close(decoder);
+    
+    if (rp.elapsed_us > 0) {
+        uint64_t dropped = 0;
+        for (int i = 0; i < pl->output_count; i++) dropped += output_dropped(pl, &pl->outputs[i]);
+        
+        printf("Replayed %lu frames in %.2f s (%.1f fps)", rp.frames, rp.elapsed_us / 1e6,
+               rp.frames * 1e6 / rp.elapsed_us);
+        print_undelivered(pl);
+        if (dropped > 0) printf(", %lu dropped by outputs", dropped);
+        printf("\n");
+    }
+    print_profile_stats(pl);
+    release_pipeline(pl);
+    cleanup_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_destroy(decoder);
+    decoder = NULL;
+    frame_player_destroy(rp.player);
+    free(pl);
+    return result < 0 ? 1 : 0;
+}
+
+/* Synthetic frames can be far larger than a camera's, so say up front when
+ * a send output cannot carry them rather than leaving receivers silent. */
+static void warn_send_limits(const pipeline_t* pl, size_t max_len) {
+    for (int i = 0; i < pl->output_count; i++) {
+        if (pl->outputs[i].type != OUTPUT_TYPE_SEND) continue;
+        
+        const udp_sender_t* sender = pl->outputs[i].handle.sender;
+        size_t segments = (max_len + sender->max_payload_per_packet - 1) / sender->max_payload_per_packet;
+        if (max_len > sender->max_frame_size) {
+            fprintf(stderr, "Warning: frames of up to %zu bytes exceed send JPEG_LEN %u and will not be sent\n",
+                    max_len, sender->max_frame_size);
+        } else if (segments > MAX_SEGMENTS_PER_FRAME) {
+            fprintf(stderr, "Warning: frames of up to %zu bytes need %zu segments of %u bytes, "
+                    "receivers accept at most %d; use a larger PACKET_LEN\n",
+                    max_len, segments, sender->max_payload_per_packet, MAX_SEGMENTS_PER_FRAME);
+        }
+    }
+}
+
+/* Frame n is due n / fps seconds after the start, rounded to the
+ * microsecond, so a rate like 30 fps does not drift. A frame released more
+ * than one interval late is counted, and the schedule is not shifted, so a
+ * stall is followed by a burst rather than a permanently lower rate. */
+static uint64_t testsrc_due(const testsrc_t* gen, uint64_t start_us, uint64_t frame) {
+    return start_us + (uint64_t)(frame * 1e6 / gen->fps + 0.5);
+}
+
+static void* testsrc_loop(void* arg) {
+    testsrc_t* gen = arg;
+    pipeline_t* pl = gen->pl;
+    uint64_t start_us = mono_us();
+    
+    while (running && (gen->opts.count == 0 || gen->frames < gen->opts.count)) {
+        if (gen->fps > 0) {
+            wait_until(testsrc_due(gen, start_us, gen->frames));
+            if (!running) break;
+            if (mono_us() > testsrc_due(gen, start_us, gen->frames + 1)) gen->late++;
+        }
+        
+        size_t len;
+        const uint8_t* data = test_source_next(gen->src, &len);
+        
+        uint64_t ts = udp_get_time_us();
+        uint64_t stage_us[FRAME_STAGE_COUNT] = {0};
+        stage_us[FRAME_STAGE_CAPTURE] = ts;
+        
+        update_profile(&pl->profile, ts);
+        process_outputs(pl, ts, stage_us, data, len);
+        gen->frames++;
+    }
+    
+    gen->elapsed_us = mono_us() - start_us;
+    running = false;
+    return NULL;
+}
+
+static int run_testsrc_pipeline(int argc, char** argv, int arg_start) {
+    if (argc < arg_start + 5) {
+        fprintf(stderr, "testsrc requires: WIDTH HEIGHT FPS QUALITY PATTERN\n");
+        return 1;
+    }
+    
+    uint32_t width = atoi(argv[arg_start]);
+    uint32_t height = atoi(argv[arg_start + 1]);
+    double fps = atof(argv[arg_start + 2]);
+    int quality = atoi(argv[arg_start + 3]);
+    int pattern = test_source_pattern(argv[arg_start + 4]);
+    int next_arg = arg_start + 5;
+    
+    if (width == 0 || height == 0 || fps < 0 || quality < 1 || quality > 100) {
+        fprintf(stderr, "Invalid testsrc parameters\n");
+        return 1;
+    }
+    if (pattern < 0) {
+        fprintf(stderr, "Unknown test pattern: %s\n", argv[arg_start + 4]);
+        return 1;
+    }
+    
+    testsrc_t src = { .opts = { .frames = TEST_SOURCE_FRAMES_DEFAULT } };
+    while (next_arg < argc && is_option(argv[next_arg])) {
+        if (parse_testsrc_option(argv[next_arg], &src.opts) < 0) {
+            fprintf(stderr, "Invalid testsrc option: %s\n", argv[next_arg]);
+            return 1;
+        }
+        next_arg++;
+    }
+    src.fps = fps;
+    
+    /* Outputs take the rate as a frame interval, FPS_NUM / FPS_DEN seconds. */
+    uint32_t fps_num = 1000;
+    uint32_t fps_den = fps > 0 ? (uint32_t)(fps * 1000 + 0.5) : 30000;
+    char title[256];
+    snprintf(title, sizeof(title), "mjpgo - testsrc %ux%u", width, height);
+    
+    pipeline_t* pl = malloc(sizeof(*pl));
+    if (!pl) return 1;
+    init_pipeline(pl, "testsrc", 0);
+    pl->width = width;
+    pl->height = height;
+    src.pl = pl;
+    
+    next_arg = parse_outputs(argc, argv, next_arg, pl->outputs, &pl->output_count,
+                             width, height, fps_num, fps_den, title);
+    if (next_arg >= 0 && next_arg < argc) {
+        fprintf(stderr, "Unknown output: %s\n", argv[next_arg]);
+        next_arg = -1;
+    }
+    if (next_arg < 0) {
+        cleanup_outputs(pl->outputs, pl->output_count);
+        free(pl);
+        return 1;
+    }
+    
+    src.src = test_source_create(width, height, quality, pattern, src.opts.frames);
+    if (!src.src) {
+        fprintf(stderr, "Failed to encode test frames\n");
+        cleanup_outputs(pl->outputs, pl->output_count);
+        free(pl);
+        return 1;
+    }
+    
+    printf("Test source %ux%u at %.2f fps, %s q%d: %u frames of %zu-%zu bytes (avg %zu)\n",
+           width, height, fps, argv[arg_start + 4], quality, src.src->frame_count,
+           src.src->min_len, src.src->max_len, src.src->total_len / src.src->frame_count);
+    
+    warn_send_limits(pl, src.src->max_len);
+    
+    int result = start_decoder(pl, 1);
+    if (result == 0) result = start_pipeline(pl, src.src->max_len);
+    if (result == 0) result = run_inputs(pl, 1, testsrc_loop, &src);
+    stop_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_close(decoder);
+    
+    if (src.elapsed_us > 0) {
+        printf("Generated %lu frames in %.2f s (%.1f fps), %lu late", src.frames,
+               src.elapsed_us / 1e6, src.frames * 1e6 / src.elapsed_us, src.late);
+        print_undelivered(pl);
+        printf("\n");
+    }
+    print_profile_stats(pl);
+    release_pipeline(pl);
+    cleanup_outputs(pl->outputs, pl->output_count);
+    jpeg_decoder_destroy(decoder);
+    decoder = NULL;
+    test_source_destroy(src.src);
+    free(pl);
+    return result < 0 ? 1 : 0;
 }
 
 int main(int argc, char** argv) {
@@ -380,16 +1953,32 @@ int main(int argc, char** argv) {
     signal(SIGTERM, signal_handler);
     
     int arg_idx = 1;
+    const char* trace_path = NULL;
     
-    if (strcmp(argv[1], "--profile") == 0) {
-        profile.enabled = true;
-        arg_idx = 2;
-        if (argc < 3) {
+    while (arg_idx < argc && strncmp(argv[arg_idx], "--", 2) == 0) {
+        if (strcmp(argv[arg_idx], "--profile") == 0) {
+            profile_enabled = true;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--trace") == 0 && arg_idx + 1 < argc) {
+            trace_path = argv[arg_idx + 1];
+            arg_idx += 2;
+        } else if (strcmp(argv[arg_idx], "--decoders") == 0 && arg_idx + 1 < argc) {
+            decoder_threads = atoi(argv[arg_idx + 1]);
+            arg_idx += 2;
+        } else if (strcmp(argv[arg_idx], "--slices") == 0 && arg_idx + 1 < argc) {
+            decoder_slices = atoi(argv[arg_idx + 1]);
+            arg_idx += 2;
+        } else {
             print_usage();
             return 1;
         }
     }
     
+    if (arg_idx >= argc) {
+        print_usage();
+        return 1;
+    }
+    
     const char* cmd = argv[arg_idx];
     
     if (strcmp(cmd, "help") == 0) {
@@ -402,15 +1991,31 @@ int main(int argc, char** argv) {
         return 0;
     }
     
-    if (strcmp(cmd, "capture") == 0) {
-        return run_capture_pipeline(argc, argv, arg_idx + 1);
+    if (strcmp(cmd, "bench") == 0) {
+        return bench_run(argc, argv, arg_idx + 1);
     }
     
-    if (strcmp(cmd, "receive") == 0) {
-        return run_receive_pipeline(argc, argv, arg_idx + 1);
+    int (*run_input)(int, char**, int) = NULL;
+    if (strcmp(cmd, "capture") == 0) run_input = run_capture_pipeline;
+    if (strcmp(cmd, "receive") == 0) run_input = run_receive_pipeline;
+    if (strcmp(cmd, "replay") == 0) run_input = run_replay_pipeline;
+    if (strcmp(cmd, "testsrc") == 0) run_input = run_testsrc_pipeline;
+    
+    if (!run_input) {
+        fprintf(stderr, "Unknown command: %s\n", cmd);
+        print_usage();
+        return 1;
     }
     
-    fprintf(stderr, "Unknown command: %s\n", cmd);
-    print_usage();
-    return 1;
+    if (trace_path) {
+        trace = frame_trace_create(trace_path);
+        if (!trace) {
+            fprintf(stderr, "Failed to open trace file: %s\n", trace_path);
+            return 1;
+        }
+    }
+    
+    int result = run_input(argc, argv, arg_idx + 1);
+    frame_trace_destroy(trace);
+    return result;
 }
@@ -0,0 +1,145 @@
+#include "../include/test_source.h"
+#include <stdlib.h>
+#include <string.h>
+#include <turbojpeg.h>
+
+#define COUNTER_DIGITS 6
+
+/* 3x5 bitmaps for 0-9, one row per 3 bits. */
+static const uint16_t digit_rows[10] = {
+    075557, 022222, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717,
+};
+
+static const char* pattern_names[] = { "gradient", "noise", "box" };
+
+int test_source_pattern(const char* name) {
+    for (int i = 0; i < (int)(sizeof(pattern_names) / sizeof(pattern_names[0])); i++) {
+        if (strcmp(name, pattern_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static void fill_rect(uint8_t* rgb, uint32_t width, uint32_t height, uint32_t x0, uint32_t y0,
+                      uint32_t w, uint32_t h, uint8_t value) {
+    for (uint32_t y = y0; y < y0 + h && y < height; y++) {
+        uint8_t* row = rgb + ((size_t)y * width + x0) * 3;
+        uint32_t span = x0 < width ? (x0 + w < width ? w : width - x0) : 0;
+        memset(row, value, (size_t)span * 3);
+    }
+}
+
+/* Zero-padded frame number in the top left corner, on a black plate. */
+static void draw_counter(uint8_t* rgb, uint32_t width, uint32_t height, uint32_t number) {
+    uint32_t cell = height / 60 > 1 ? height / 60 : 1;
+    fill_rect(rgb, width, height, 0, 0, (COUNTER_DIGITS * 4 + 1) * cell, 7 * cell, 0);
+    
+    for (int d = COUNTER_DIGITS - 1; d >= 0; d--, number /= 10) {
+        uint16_t bits = digit_rows[number % 10];
+        for (uint32_t r = 0; r < 5; r++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                if (!(bits >> ((4 - r) * 3 + (2 - c)) & 1)) continue;
+                fill_rect(rgb, width, height, (1 + d * 4 + c) * cell, (1 + r) * cell, cell, cell, 255);
+            }
+        }
+    }
+}
+
+static void draw_frame(uint8_t* rgb, uint32_t width, uint32_t height, int pattern,
+                       uint32_t index, uint32_t count) {
+    uint32_t shift = index * 256 / count;
+    uint32_t seed = index * 2654435761u + 1;
+    
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t* px = rgb + (size_t)y * width * 3;
+        for (uint32_t x = 0; x < width; x++, px += 3) {
+            if (pattern == TEST_PATTERN_NOISE) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                px[0] = seed;
+                px[1] = seed >> 8;
+                px[2] = seed >> 16;
+            } else if (pattern == TEST_PATTERN_GRADIENT) {
+                px[0] = (x * 256 / width + shift) & 255;
+                px[1] = (y * 256 / height + shift) & 255;
+                px[2] = ((x + y) * 128 / (width + height) + 128 - shift) & 255;
+            } else {
+                px[0] = px[1] = px[2] = 48 + y * 64 / height;
+            }
+        }
+    }
+    
+    if (pattern == TEST_PATTERN_BOX) {
+        uint32_t size = height / 4;
+        uint32_t x = (uint64_t)(width - size) * index / count;
+        fill_rect(rgb, width, height, x, (height - size) / 2, size, size, 230);
+    }
+    
+    draw_counter(rgb, width, height, index);
+}
+
+/* Every frame is encoded up front, so producing a frame costs nothing and
+ * the output rate is limited only by the pipeline. Frame size follows from
+ * the pattern (noise is close to incompressible) and the quality. */
+test_source_t* test_source_create(uint32_t width, uint32_t height, int quality,
+                                  int pattern, uint32_t frame_count) {
+    if (width == 0 || height == 0 || quality < 1 || quality > 100) return NULL;
+    if (pattern < TEST_PATTERN_GRADIENT || pattern > TEST_PATTERN_BOX || frame_count == 0) return NULL;
+    
+    test_source_t* src = calloc(1, sizeof(*src));
+    if (!src) return NULL;
+    
+    src->width = width;
+    src->height = height;
+    src->frames = calloc(frame_count, sizeof(uint8_t*));
+    src->lengths = calloc(frame_count, sizeof(size_t));
+    uint8_t* rgb = malloc((size_t)width * height * 3);
+    tjhandle tj = tjInitCompress();
+    if (!src->frames || !src->lengths || !rgb || !tj) goto fail;
+    
+    for (uint32_t i = 0; i < frame_count; i++) {
+        draw_frame(rgb, width, height, pattern, i, frame_count);
+        
+        unsigned long len = 0;
+        if (tjCompress2(tj, rgb, width, 0, height, TJPF_RGB, &src->frames[i], &len,
+                        TJSAMP_422, quality, TJFLAG_FASTDCT) < 0) {
+            /* turbojpeg may have allocated the buffer before failing */
+            tjFree(src->frames[i]);
+            src->frames[i] = NULL;
+            goto fail;
+        }
+        src->frame_count++;
+        src->lengths[i] = len;
+        src->total_len += len;
+        if (src->min_len == 0 || len < src->min_len) src->min_len = len;
+        if (len > src->max_len) src->max_len = len;
+    }
+    
+    tjDestroy(tj);
+    free(rgb);
+    return src;
+
+fail:
+    if (tj) tjDestroy(tj);
+    free(rgb);
+    test_source_destroy(src);
+    return NULL;
+}
+
+const uint8_t* test_source_next(test_source_t* src, size_t* len) {
+    if (!src || !len) return NULL;
+    
+    uint32_t i = src->next;
+    src->next = (i + 1) % src->frame_count;
+    *len = src->lengths[i];
+    return src->frames[i];
+}
+
+void test_source_destroy(test_source_t* src) {
+    if (!src) return;
+    
+    for (uint32_t i = 0; i < src->frame_count; i++) tjFree(src->frames[i]);
+    free(src->lengths);
+    free(src->frames);
+    free(src);
+}
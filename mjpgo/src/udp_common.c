@@ -57,3 +57,22 @@ uint64_t udp_get_time_us(void) {
     gettimeofday(&tv, NULL);
     return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
 }
+
+/* Parity group g covers segments g, g + groups, g + 2 * groups, ... so a
+ * burst of consecutive losses is spread across different groups. */
+uint32_t udp_fec_group_count(uint32_t seg_count, uint32_t fec_k) {
+    if (fec_k == 0) return 0;
+    return (seg_count + fec_k - 1) / fec_k;
+}
+
+void udp_fec_xor(uint8_t* dst, const uint8_t* src, uint32_t len) {
+    uint32_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < len; i++) dst[i] ^= src[i];
+}
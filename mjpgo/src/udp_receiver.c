@@ -1,8 +1,13 @@
+#define _GNU_SOURCE
 #include "../include/udp_receiver.h"
+#include <arpa/inet.h>
 #include <endian.h>
 #include <errno.h>
+#include <netinet/udp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 static inline void bitmap_clear(uint64_t* bm) {
@@ -17,6 +22,46 @@ static inline bool bitmap_test(const uint64_t* bm, uint32_t idx) {
     return (bm[idx / 64] & (1ULL << (idx % 64))) != 0;
 }
 
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void free_slots(udp_receiver_t* recv) {
+    if (recv->slots) {
+        for (uint32_t i = 0; i < recv->slot_count; i++) {
+            free(recv->slots[i].buf);
+            free(recv->slots[i].parity);
+        }
+    }
+    free(recv->slots);
+    recv->slots = NULL;
+    recv->slot_count = 0;
+    recv->current = NULL;
+    recv->batch_slot = NULL;
+    recv->frame_buf = NULL;
+}
+
+static int alloc_slots(udp_receiver_t* recv, uint32_t slot_count) {
+    free_slots(recv);
+    
+    recv->slots = calloc(slot_count, sizeof(udp_frame_slot_t));
+    if (!recv->slots) return -1;
+    
+    for (uint32_t i = 0; i < slot_count; i++) {
+        recv->slots[i].buf = malloc(recv->max_frame_size);
+        if (!recv->slots[i].buf) {
+            free_slots(recv);
+            return -1;
+        }
+        recv->slot_count++;
+    }
+    
+    recv->frame_buf = recv->slots[0].buf;
+    return 0;
+}
+
 udp_receiver_t* udp_receiver_create(const char* local_ip, uint16_t local_port,
                                      uint32_t max_packet_size, uint32_t max_frame_size) {
     udp_receiver_t* recv = calloc(1, sizeof(*recv));
@@ -25,6 +70,7 @@ udp_receiver_t* udp_receiver_create(const char* local_ip, uint16_t local_port,
     recv->max_packet_size = max_packet_size;
     recv->max_payload_per_packet = max_packet_size - PACKET_HEADER_SIZE;
     recv->max_frame_size = max_frame_size;
+    recv->deadline_us = UDP_RECEIVER_DEADLINE_DEFAULT_MS * 1000ULL;
     
     recv->packet_buf = malloc(max_packet_size);
     if (!recv->packet_buf) {
@@ -32,71 +78,672 @@ udp_receiver_t* udp_receiver_create(const char* local_ip, uint16_t local_port,
         return NULL;
     }
     
-    recv->frame_buf = malloc(max_frame_size);
-    if (!recv->frame_buf) {
+    if (alloc_slots(recv, UDP_RECEIVER_SLOTS_DEFAULT) < 0) {
         free(recv->packet_buf);
         free(recv);
         return NULL;
     }
     
     if (udp_create_socket(local_ip, local_port, &recv->local) < 0) {
-        free(recv->frame_buf);
+        free_slots(recv);
         free(recv->packet_buf);
         free(recv);
         return NULL;
     }
     
-    recv->tracked_ts = 0;
-    bitmap_clear(recv->segment_bitmap);
+    recv->rx_mode = UDP_RX_RECVFROM;
     
     return recv;
 }
 
-bool udp_receiver_get_frame(udp_receiver_t* recv) {
-    if (!recv) return false;
+int udp_receiver_set_window(udp_receiver_t* recv, uint32_t slot_count, uint32_t deadline_ms) {
+    if (!recv) return -1;
+    if (slot_count == 0 || slot_count > UDP_RECEIVER_SLOTS_MAX || deadline_ms == 0) return -1;
     
-    while (1) {
-        ssize_t bytes_in;
-        do {
-            bytes_in = recvfrom(recv->local.sock_fd, recv->packet_buf, 
-                               recv->max_packet_size, 0, NULL, NULL);
-        } while (bytes_in < 0 && errno == EINTR);
+    if (alloc_slots(recv, slot_count) < 0) return -1;
+    
+    recv->deadline_us = deadline_ms * 1000ULL;
+    recv->batch_count = 0;
+    recv->batch_next = 0;
+    recv->batch_offset = 0;
+    return 0;
+}
+
+#define GRO_CONTROL_SIZE CMSG_SPACE(sizeof(int))
+
+static void free_batch(udp_receiver_t* recv) {
+    free(recv->batch_addrs);
+    free(recv->batch_control);
+    free(recv->batch_spill);
+    free(recv->batch_placed);
+    free(recv->batch_payloads);
+    free(recv->batch_msgs);
+    free(recv->batch_iovs);
+    free(recv->batch_headers);
+    recv->batch_addrs = NULL;
+    recv->batch_control = NULL;
+    recv->batch_spill = NULL;
+    recv->batch_placed = NULL;
+    recv->batch_payloads = NULL;
+    recv->batch_msgs = NULL;
+    recv->batch_iovs = NULL;
+    recv->batch_headers = NULL;
+    recv->batch_size = 0;
+}
+
+int udp_receiver_set_rx_mode(udp_receiver_t* recv, int rx_mode, uint32_t batch_size) {
+    if (!recv) return -1;
+    if (rx_mode != UDP_RX_RECVFROM && rx_mode != UDP_RX_MMSG && rx_mode != UDP_RX_GRO) return -1;
+    
+    int gro = rx_mode == UDP_RX_GRO;
+    if (setsockopt(recv->local.sock_fd, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) < 0 && gro) {
+        return -1;
+    }
+    
+    free_batch(recv);
+    recv->batch_count = 0;
+    recv->batch_next = 0;
+    recv->batch_offset = 0;
+    recv->rx_mode = rx_mode;
+    if (rx_mode == UDP_RX_RECVFROM) return 0;
+    
+    if (batch_size == 0) batch_size = UDP_RECEIVER_BATCH_DEFAULT;
+    if (batch_size > UIO_MAXIOV) batch_size = UIO_MAXIOV;
+    if (gro && batch_size > UDP_GRO_BATCH_MAX) batch_size = UDP_GRO_BATCH_MAX;
+    
+    size_t slot_size = gro ? UDP_GRO_BUFFER_SIZE : recv->max_payload_per_packet;
+    
+    recv->batch_headers = calloc(batch_size, sizeof(packet_header_t));
+    recv->batch_iovs = calloc((size_t)batch_size * 2, sizeof(struct iovec));
+    recv->batch_msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    recv->batch_payloads = calloc(batch_size, sizeof(uint8_t*));
+    recv->batch_placed = calloc(batch_size, sizeof(bool));
+    recv->batch_spill = malloc((size_t)batch_size * slot_size);
+    recv->batch_control = calloc(batch_size, GRO_CONTROL_SIZE);
+    recv->batch_addrs = calloc(batch_size, sizeof(struct sockaddr_in));
+    
+    if (!recv->batch_headers || !recv->batch_iovs || !recv->batch_msgs ||
+        !recv->batch_payloads || !recv->batch_placed || !recv->batch_spill ||
+        !recv->batch_control || !recv->batch_addrs) {
+        free_batch(recv);
+        recv->rx_mode = UDP_RX_RECVFROM;
+        return -1;
+    }
+    
+    recv->batch_size = batch_size;
+    return 0;
+}
+
+int udp_receiver_set_nack(udp_receiver_t* recv, uint32_t interval_ms) {
+    if (!recv) return -1;
+    
+    struct timeval timeout = { .tv_sec = interval_ms / 1000, .tv_usec = (interval_ms % 1000) * 1000 };
+    if (setsockopt(recv->local.sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        return -1;
+    }
+    
+    recv->nack_interval_us = interval_ms * 1000ULL;
+    return 0;
+}
+
+int udp_receiver_set_clock_sync(udp_receiver_t* recv, bool enabled) {
+    if (!recv) return -1;
+    
+    recv->clock_enabled = enabled;
+    recv->clock_ping_at_us = 0;
+    recv->clock_pings = 0;
+    clock_sync_reset(&recv->clock);
+    return 0;
+}
+
+/* Arrival times only feed the first/last packet stamps and the clock
+ * sync, so the clock is read only when one of them is wanted. */
+int udp_receiver_set_packet_times(udp_receiver_t* recv, bool enabled) {
+    if (!recv) return -1;
+    
+    recv->packet_times = enabled;
+    return 0;
+}
+
+uint64_t udp_receiver_local_time(const udp_receiver_t* recv, uint64_t remote_us) {
+    if (!recv || !recv->clock.valid) return remote_us;
+    return remote_us - clock_sync_offset_at(&recv->clock, remote_us);
+}
+
+static void stamp_packets(udp_receiver_t* recv) {
+    recv->packet_time_us = recv->packet_times || recv->clock_enabled ? udp_get_time_us() : 0;
+}
+
+static void note_peer(udp_receiver_t* recv, const struct sockaddr_in* addr) {
+    recv->peer = *addr;
+    recv->has_peer = true;
+}
+
+static void send_nack(udp_receiver_t* recv, udp_frame_slot_t* slot, uint64_t now) {
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (uint32_t seg = 0; seg < slot->segments_expected; seg++) {
+        if (bitmap_test(slot->segment_bitmap, seg)) continue;
+        if (first == UINT32_MAX) first = seg;
+        last = seg;
+    }
+    if (first == UINT32_MAX) return;
+    
+    uint8_t packet[PACKET_HEADER_SIZE + PACKET_NACK_MAX_BYTES];
+    uint32_t base = first & ~7u;
+    uint32_t bytes = (last - base) / 8 + 1;
+    uint8_t* bitmap = packet + PACKET_HEADER_SIZE;
+    memset(bitmap, 0, bytes);
+    
+    for (uint32_t seg = first; seg <= last; seg++) {
+        if (!bitmap_test(slot->segment_bitmap, seg)) bitmap[(seg - base) / 8] |= 1u << ((seg - base) % 8);
+    }
+    
+    packet_header_t* hdr = (packet_header_t*)packet;
+    hdr->frame_ts_us = htobe64(slot->ts);
+    hdr->seg_idx = htonl(PACKET_CONTROL_FLAG | PACKET_CONTROL_NACK);
+    hdr->seg_count = htonl(base);
+    hdr->payload_len = htonl(bytes);
+    
+    sendto(recv->local.sock_fd, packet, PACKET_HEADER_SIZE + bytes, 0,
+           (struct sockaddr*)&recv->peer, sizeof(recv->peer));
+    
+    recv->stats.nacks++;
+    slot->nacks_sent++;
+    slot->nack_at_us = now + recv->nack_interval_us;
+}
+
+/* Only the newest frame whose tail has been seen is NACKed: anything older
+ * is abandoned as soon as it completes, so repairing it is wasted effort. */
+static void service_nacks(udp_receiver_t* recv, uint64_t now) {
+    if (!recv->nack_interval_us || !recv->has_peer) return;
+    
+    udp_frame_slot_t* newest = NULL;
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        udp_frame_slot_t* slot = &recv->slots[i];
+        if (!slot->active || !slot->nack_ready) continue;
+        if (!newest || slot->ts > newest->ts) newest = slot;
+    }
+    
+    if (!newest || newest->nacks_sent >= UDP_NACK_MAX_RETRIES || now < newest->nack_at_us) return;
+    send_nack(recv, newest, now);
+}
+
+/* Pings go to the stream's source, whose feedback thread answers with its
+ * own receive and send times; the first few are sent quickly so the offset
+ * is usable within a second. */
+static void service_clock(udp_receiver_t* recv, uint64_t now) {
+    if (!recv->clock_enabled || !recv->has_peer || now < recv->clock_ping_at_us) return;
+    
+    packet_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.frame_ts_us = htobe64(udp_get_time_us());
+    hdr.seg_idx = htonl(PACKET_CONTROL_FLAG | PACKET_CONTROL_PING);
+    
+    sendto(recv->local.sock_fd, &hdr, PACKET_HEADER_SIZE, 0,
+           (struct sockaddr*)&recv->peer, sizeof(recv->peer));
+    
+    recv->clock_pings++;
+    uint32_t interval_ms = recv->clock_pings < UDP_CLOCK_FAST_PINGS ? UDP_CLOCK_FAST_PING_MS : UDP_CLOCK_PING_MS;
+    recv->clock_ping_at_us = now + interval_ms * 1000ULL;
+}
+
+static void accept_pong(udp_receiver_t* recv, const packet_header_t* hdr,
+                        const uint8_t* payload, uint32_t payload_len) {
+    if (!recv->clock_enabled || payload_len != PACKET_PONG_BYTES) return;
+    
+    uint64_t remote[2];
+    memcpy(remote, payload, sizeof(remote));
+    clock_sync_add_sample(&recv->clock, be64toh(hdr->frame_ts_us), be64toh(remote[0]),
+                          be64toh(remote[1]), recv->packet_time_us);
+}
+
+static void release_slot(udp_receiver_t* recv, udp_frame_slot_t* slot, bool delivered) {
+    if (!delivered) recv->stats.incomplete++;
+    slot->active = false;
+    if (recv->current == slot) recv->current = NULL;
+}
+
+static void expire_slots(udp_receiver_t* recv, uint64_t now) {
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        udp_frame_slot_t* slot = &recv->slots[i];
+        if (slot->active && now >= slot->deadline_us) release_slot(recv, slot, false);
+    }
+}
+
+/* Deadlines are only checked when a new frame starts, which keeps the clock
+ * read off the per-packet path; a frame cannot go stale unseen because
+ * the next frame's first packet always passes through here. */
+static udp_frame_slot_t* find_slot(udp_receiver_t* recv, uint64_t ts, uint32_t seg_count) {
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        udp_frame_slot_t* slot = &recv->slots[i];
+        if (slot->active && slot->ts == ts) return slot;
+    }
+    
+    uint64_t now = monotonic_us();
+    expire_slots(recv, now);
+    
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        if (recv->slots[i].active && recv->slots[i].ts < ts) recv->slots[i].nack_ready = true;
+    }
+    service_nacks(recv, now);
+    service_clock(recv, now);
+    
+    udp_frame_slot_t* free_slot = NULL;
+    udp_frame_slot_t* oldest = NULL;
+    
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        udp_frame_slot_t* slot = &recv->slots[i];
+        if (!slot->active) {
+            if (!free_slot) free_slot = slot;
+        } else if (!oldest || slot->ts < oldest->ts) {
+            oldest = slot;
+        }
+    }
+    
+    udp_frame_slot_t* slot = free_slot;
+    if (!slot) {
+        if (ts < oldest->ts) return NULL;
+        release_slot(recv, oldest, false);
+        slot = oldest;
+    }
+    
+    slot->active = true;
+    slot->generation++;
+    slot->ts = ts;
+    slot->deadline_us = now + recv->deadline_us;
+    slot->segments_received = 0;
+    slot->segments_expected = seg_count;
+    slot->next_seg = 0;
+    slot->frame_len = 0;
+    slot->fec_k = 0;
+    slot->fec_groups = 0;
+    slot->nack_ready = false;
+    slot->nacks_sent = 0;
+    slot->nack_at_us = 0;
+    slot->first_packet_us = recv->packet_time_us;
+    bitmap_clear(slot->segment_bitmap);
+    bitmap_clear(slot->parity_bitmap);
+    return slot;
+}
+
+/* Frames are handed out in timestamp order: completing a frame abandons any
+ * older frame still being assembled, and packets for frames at or before the
+ * last delivered one are stale. A jump back of more than
+ * UDP_RECEIVER_RESET_US is taken as a restarted sender. */
+static void deliver_slot(udp_receiver_t* recv, udp_frame_slot_t* slot) {
+    recv->frame_buf = slot->buf;
+    recv->frame_len = slot->frame_len;
+    recv->frame_ts_us = slot->ts;
+    recv->frame_first_us = slot->first_packet_us;
+    recv->frame_last_us = slot->last_packet_us;
+    recv->delivered_ts = slot->ts;
+    recv->delivered_any = true;
+    recv->stats.frames++;
+    
+    release_slot(recv, slot, true);
+    
+    for (uint32_t i = 0; i < recv->slot_count; i++) {
+        udp_frame_slot_t* other = &recv->slots[i];
+        if (other->active && other->ts < slot->ts) release_slot(recv, other, false);
+    }
+}
+
+static void mark_segment(udp_receiver_t* recv, udp_frame_slot_t* slot, uint32_t seg_idx) {
+    bitmap_set(slot->segment_bitmap, seg_idx);
+    slot->segments_received++;
+    if (seg_idx >= slot->next_seg) slot->next_seg = seg_idx + 1;
+    recv->current = slot;
+}
+
+/* A group with its parity and all but one segment rebuilds the missing
+ * segment by XOR; segments past the frame end count as zero padding. */
+static void recover_group(udp_receiver_t* recv, udp_frame_slot_t* slot, uint32_t group) {
+    if (!bitmap_test(slot->parity_bitmap, group)) return;
+    
+    uint32_t stride = recv->max_payload_per_packet;
+    uint32_t last = slot->segments_expected - 1;
+    uint32_t missing = UINT32_MAX;
+    
+    for (uint32_t seg = group; seg <= last; seg += slot->fec_groups) {
+        if (bitmap_test(slot->segment_bitmap, seg)) continue;
+        if (missing != UINT32_MAX) return;
+        missing = seg;
+    }
+    if (missing == UINT32_MAX) return;
+    
+    uint8_t* dst = slot->buf + (size_t)missing * stride;
+    uint32_t len = missing == last ? slot->frame_len - missing * stride : stride;
+    memcpy(dst, slot->parity + (size_t)group * stride, len);
+    
+    for (uint32_t seg = group; seg <= last; seg += slot->fec_groups) {
+        if (seg == missing) continue;
+        uint32_t seg_len = seg == last ? slot->frame_len - seg * stride : stride;
+        udp_fec_xor(dst, slot->buf + (size_t)seg * stride, seg_len < len ? seg_len : len);
+    }
+    
+    mark_segment(recv, slot, missing);
+    recv->stats.recovered++;
+}
+
+static bool accept_parity(udp_receiver_t* recv, udp_frame_slot_t* slot, uint32_t fec_k,
+                          uint32_t group, uint32_t frame_len, const uint8_t* payload,
+                          uint32_t payload_len) {
+    uint32_t stride = recv->max_payload_per_packet;
+    
+    /* The parity buffer grows to the groups of the largest frame seen in
+     * this slot, not to the worst case of fec=1 at JPEG_LEN. */
+    if (slot->fec_k == 0) {
+        uint32_t groups = udp_fec_group_count(slot->segments_expected, fec_k);
+        if (groups > slot->parity_capacity) {
+            uint8_t* parity = realloc(slot->parity, (size_t)groups * stride);
+            if (!parity) return false;
+            slot->parity = parity;
+            slot->parity_capacity = groups;
+        }
+        slot->fec_k = fec_k;
+        slot->fec_groups = groups;
+        slot->frame_len = frame_len;
+    }
+    
+    if (slot->fec_k != fec_k || slot->frame_len != frame_len) return false;
+    if (group >= slot->fec_groups || bitmap_test(slot->parity_bitmap, group)) return false;
+    
+    uint8_t* parity = slot->parity + (size_t)group * stride;
+    memcpy(parity, payload, payload_len);
+    memset(parity + payload_len, 0, stride - payload_len);
+    bitmap_set(slot->parity_bitmap, group);
+    recv->stats.copies++;
+    
+    recover_group(recv, slot, group);
+    return true;
+}
+
+static bool accept_packet(udp_receiver_t* recv, const packet_header_t* hdr,
+                          const uint8_t* payload, ssize_t bytes_in, bool placed) {
+    if (bytes_in < (ssize_t)PACKET_HEADER_SIZE) return false;
+    
+    uint64_t ts = be64toh(hdr->frame_ts_us);
+    uint32_t seg_idx = ntohl(hdr->seg_idx);
+    uint32_t seg_count = ntohl(hdr->seg_count);
+    uint32_t payload_len = ntohl(hdr->payload_len);
+    
+    if ((ssize_t)(PACKET_HEADER_SIZE + payload_len) != bytes_in) return false;
+    
+    bool parity = (seg_idx & PACKET_FEC_FLAG) != 0;
+    uint32_t frame_len = seg_count;
+    if (parity) {
+        if (placed || payload_len > recv->max_payload_per_packet) return false;
+        if (frame_len == 0 || frame_len > recv->max_frame_size) return false;
+        seg_count = (frame_len + recv->max_payload_per_packet - 1) / recv->max_payload_per_packet;
+    } else if (seg_idx & PACKET_CONTROL_FLAG) {
+        if (seg_idx == (PACKET_CONTROL_FLAG | PACKET_CONTROL_PONG)) accept_pong(recv, hdr, payload, payload_len);
+        return false;
+    } else if (seg_idx >= MAX_SEGMENTS_PER_FRAME) {
+        return false;
+    }
+    if (seg_count > MAX_SEGMENTS_PER_FRAME) return false;
+    
+    recv->stats.packets++;
+    
+    if (recv->delivered_any && ts <= recv->delivered_ts) {
+        if (recv->delivered_ts - ts < UDP_RECEIVER_RESET_US) {
+            recv->stats.stale++;
+            return false;
+        }
+        recv->delivered_any = false;
+    }
+    
+    udp_frame_slot_t* slot = find_slot(recv, ts, seg_count);
+    if (!slot) {
+        recv->stats.stale++;
+        return false;
+    }
+    slot->last_packet_us = recv->packet_time_us;
+    
+    if (parity) {
+        uint32_t fec_k = (seg_idx >> PACKET_FEC_K_SHIFT) & PACKET_FEC_K_MASK;
+        uint32_t group = seg_idx & PACKET_FEC_GROUP_MASK;
+        if (fec_k == 0 || !accept_parity(recv, slot, fec_k, group, frame_len, payload, payload_len)) {
+            return false;
+        }
+    } else {
+        /* A directly placed payload is only valid in the slot it was read
+         * into, and only while that slot still holds the same frame: once
+         * it completes or is evicted mid-batch and is taken again, even for
+         * the same timestamp, other payloads may have been copied over it. */
+        if (placed && (slot != recv->batch_slot || slot->generation != recv->batch_generation)) return false;
         
-        if (bytes_in < 0 && errno == EBADF) return false;
-        if (bytes_in < (ssize_t)PACKET_HEADER_SIZE) continue;
+        if (bitmap_test(slot->segment_bitmap, seg_idx)) return false;
         
-        const packet_header_t* hdr = (const packet_header_t*)recv->packet_buf;
-        uint64_t ts = be64toh(hdr->frame_ts_us);
-        uint32_t seg_idx = ntohl(hdr->seg_idx);
-        uint32_t seg_count = ntohl(hdr->seg_count);
-        uint32_t payload_len = ntohl(hdr->payload_len);
+        uint32_t offset = seg_idx * recv->max_payload_per_packet;
+        if (offset + payload_len > recv->max_frame_size) return false;
         
-        if ((ssize_t)(PACKET_HEADER_SIZE + payload_len) != bytes_in) continue;
-        if (seg_idx >= MAX_SEGMENTS_PER_FRAME) continue;
-        if (seg_count > MAX_SEGMENTS_PER_FRAME) continue;
+        if (!placed) {
+            memcpy(slot->buf + offset, payload, payload_len);
+            recv->stats.copies++;
+        }
+        mark_segment(recv, slot, seg_idx);
         
-        if (recv->tracked_ts != ts) {
-            recv->tracked_ts = ts;
-            recv->segments_received = 0;
-            recv->segments_expected = seg_count;
-            bitmap_clear(recv->segment_bitmap);
+        if (seg_idx == seg_count - 1) {
+            slot->frame_len = offset + payload_len;
         }
         
-        if (bitmap_test(recv->segment_bitmap, seg_idx)) continue;
+        if (slot->fec_k) recover_group(recv, slot, seg_idx % slot->fec_groups);
         
-        uint32_t offset = seg_idx * recv->max_payload_per_packet;
-        if (offset + payload_len > recv->max_frame_size) continue;
+        if (seg_idx == seg_count - 1 && slot->segments_received < slot->segments_expected) {
+            slot->nack_ready = true;
+            service_nacks(recv, monotonic_us());
+        }
+    }
+    
+    if (slot->segments_received == slot->segments_expected) {
+        deliver_slot(recv, slot);
+        return true;
+    }
+    
+    return false;
+}
+
+/* With NACKs enabled the socket has a receive timeout, so a stalled stream
+ * still gets its retries sent. */
+static int receive_failed(udp_receiver_t* recv) {
+    if (errno == EBADF) return -1;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        uint64_t now = monotonic_us();
+        service_nacks(recv, now);
+        service_clock(recv, now);
+    }
+    return 0;
+}
+
+/* Payloads are scattered straight to the offset the next in-order segment
+ * of the most recently fed frame slot would occupy. Slots past the end of that frame read
+ * into a spill area instead, and any datagram that did not land where it
+ * belongs is moved to its spill slot before the batch is processed, so no
+ * later placement can overwrite it. */
+static int receive_batch(udp_receiver_t* recv) {
+    uint32_t stride = recv->max_payload_per_packet;
+    udp_frame_slot_t* target = recv->current;
+    uint64_t batch_ts = target ? target->ts : 0;
+    uint32_t first_seg = target ? target->next_seg : 0;
+    uint32_t expected = target ? target->segments_expected : 0;
+    recv->batch_slot = target;
+    recv->batch_generation = target ? target->generation : 0;
+    
+    for (uint32_t i = 0; i < recv->batch_size; i++) {
+        uint32_t seg = first_seg + i;
+        uint8_t* spill = recv->batch_spill + (size_t)i * stride;
         
-        memcpy(recv->frame_buf + offset, recv->packet_buf + PACKET_HEADER_SIZE, payload_len);
-        bitmap_set(recv->segment_bitmap, seg_idx);
-        recv->segments_received++;
+        bool direct = seg < expected &&
+                      (uint64_t)(seg + 1) * stride <= recv->max_frame_size;
+        recv->batch_placed[i] = direct;
+        recv->batch_payloads[i] = direct ? target->buf + (size_t)seg * stride : spill;
         
-        if (seg_idx == seg_count - 1) {
-            recv->frame_len = offset + payload_len;
-            recv->frame_ts_us = ts;
+        struct iovec* iov = &recv->batch_iovs[i * 2];
+        iov[0].iov_base = &recv->batch_headers[i];
+        iov[0].iov_len = PACKET_HEADER_SIZE;
+        iov[1].iov_base = recv->batch_payloads[i];
+        iov[1].iov_len = stride;
+        
+        struct msghdr* msg = &recv->batch_msgs[i].msg_hdr;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = &recv->batch_addrs[i];
+        msg->msg_namelen = sizeof(recv->batch_addrs[i]);
+        msg->msg_iov = iov;
+        msg->msg_iovlen = 2;
+        recv->batch_msgs[i].msg_len = 0;
+    }
+    
+    int count;
+    do {
+        count = recvmmsg(recv->local.sock_fd, recv->batch_msgs, recv->batch_size,
+                         MSG_WAITFORONE, NULL);
+        recv->stats.syscalls++;
+    } while (count < 0 && errno == EINTR);
+    
+    if (count < 0) return receive_failed(recv);
+    stamp_packets(recv);
+    
+    for (int i = 0; i < count; i++) {
+        if (!recv->batch_placed[i]) continue;
+        
+        const packet_header_t* hdr = &recv->batch_headers[i];
+        if (be64toh(hdr->frame_ts_us) == batch_ts && ntohl(hdr->seg_idx) == first_seg + (uint32_t)i) {
+            continue;
+        }
+        
+        uint8_t* spill = recv->batch_spill + (size_t)i * stride;
+        uint32_t len = recv->batch_msgs[i].msg_len;
+        if (len > PACKET_HEADER_SIZE) {
+            memcpy(spill, recv->batch_payloads[i], len - PACKET_HEADER_SIZE);
+        }
+        recv->batch_payloads[i] = spill;
+        recv->batch_placed[i] = false;
+    }
+    
+    recv->batch_count = count;
+    recv->batch_next = 0;
+    return 0;
+}
+
+static bool get_frame_batched(udp_receiver_t* recv) {
+    while (1) {
+        if (recv->batch_next == recv->batch_count) {
+            if (receive_batch(recv) < 0) return false;
+            continue;
+        }
+        
+        uint32_t i = recv->batch_next++;
+        note_peer(recv, &recv->batch_addrs[i]);
+        if (accept_packet(recv, &recv->batch_headers[i], recv->batch_payloads[i],
+                          recv->batch_msgs[i].msg_len, recv->batch_placed[i])) {
+            return true;
+        }
+    }
+}
+
+static int receive_gro_batch(udp_receiver_t* recv) {
+    for (uint32_t i = 0; i < recv->batch_size; i++) {
+        struct iovec* iov = &recv->batch_iovs[i];
+        iov->iov_base = recv->batch_spill + (size_t)i * UDP_GRO_BUFFER_SIZE;
+        iov->iov_len = UDP_GRO_BUFFER_SIZE;
+        
+        struct msghdr* msg = &recv->batch_msgs[i].msg_hdr;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = &recv->batch_addrs[i];
+        msg->msg_namelen = sizeof(recv->batch_addrs[i]);
+        msg->msg_iov = iov;
+        msg->msg_iovlen = 1;
+        msg->msg_control = recv->batch_control + (size_t)i * GRO_CONTROL_SIZE;
+        msg->msg_controllen = GRO_CONTROL_SIZE;
+        recv->batch_msgs[i].msg_len = 0;
+    }
+    
+    int count;
+    do {
+        count = recvmmsg(recv->local.sock_fd, recv->batch_msgs, recv->batch_size,
+                         MSG_WAITFORONE, NULL);
+        recv->stats.syscalls++;
+    } while (count < 0 && errno == EINTR);
+    
+    if (count < 0) return receive_failed(recv);
+    stamp_packets(recv);
+    
+    recv->batch_count = count;
+    recv->batch_next = 0;
+    recv->batch_offset = 0;
+    return 0;
+}
+
+static uint32_t gro_segment_size(struct msghdr* msg, uint32_t msg_len) {
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int seg_size;
+            memcpy(&seg_size, CMSG_DATA(cm), sizeof(seg_size));
+            if (seg_size > 0) return (uint32_t)seg_size;
+        }
+    }
+    return msg_len;
+}
+
+/* A coalesced GRO buffer holds back-to-back datagrams of gso_size bytes,
+ * each still starting with its own packet_header_t. */
+static bool get_frame_gro(udp_receiver_t* recv) {
+    while (1) {
+        if (recv->batch_next == recv->batch_count) {
+            if (receive_gro_batch(recv) < 0) return false;
+            continue;
+        }
+        
+        struct mmsghdr* mm = &recv->batch_msgs[recv->batch_next];
+        uint8_t* base = recv->batch_spill + (size_t)recv->batch_next * UDP_GRO_BUFFER_SIZE;
+        uint32_t seg_size = gro_segment_size(&mm->msg_hdr, mm->msg_len);
+        
+        uint32_t offset = recv->batch_offset;
+        uint32_t len = mm->msg_len - offset;
+        if (len > seg_size) len = seg_size;
+        
+        recv->batch_offset += len;
+        if (len == 0 || recv->batch_offset >= mm->msg_len) {
+            recv->batch_next++;
+            recv->batch_offset = 0;
         }
         
-        if (recv->segments_received == recv->segments_expected) {
+        const packet_header_t* hdr = (const packet_header_t*)(base + offset);
+        note_peer(recv, &recv->batch_addrs[mm - recv->batch_msgs]);
+        if (accept_packet(recv, hdr, base + offset + PACKET_HEADER_SIZE, len, false)) {
+            return true;
+        }
+    }
+}
+
+bool udp_receiver_get_frame(udp_receiver_t* recv) {
+    if (!recv) return false;
+    
+    if (recv->rx_mode == UDP_RX_GRO) return get_frame_gro(recv);
+    if (recv->rx_mode == UDP_RX_MMSG) return get_frame_batched(recv);
+    
+    while (1) {
+        struct sockaddr_in src;
+        socklen_t src_len;
+        ssize_t bytes_in;
+        do {
+            src_len = sizeof(src);
+            bytes_in = recvfrom(recv->local.sock_fd, recv->packet_buf, 
+                               recv->max_packet_size, 0, (struct sockaddr*)&src, &src_len);
+            recv->stats.syscalls++;
+        } while (bytes_in < 0 && errno == EINTR);
+        
+        if (bytes_in < 0) {
+            if (receive_failed(recv) < 0) return false;
+            continue;
+        }
+        stamp_packets(recv);
+        note_peer(recv, &src);
+        
+        const packet_header_t* hdr = (const packet_header_t*)recv->packet_buf;
+        if (accept_packet(recv, hdr, recv->packet_buf + PACKET_HEADER_SIZE, bytes_in, false)) {
             return true;
         }
     }
@@ -105,7 +752,8 @@ bool udp_receiver_get_frame(udp_receiver_t* recv) {
 void udp_receiver_destroy(udp_receiver_t* recv) {
     if (!recv) return;
     udp_close_socket(&recv->local);
-    free(recv->frame_buf);
+    free_batch(recv);
+    free_slots(recv);
     free(recv->packet_buf);
     free(recv);
 }
@@ -1,11 +1,22 @@
+#define _GNU_SOURCE
 #include "../include/udp_sender.h"
 #include <arpa/inet.h>
 #include <endian.h>
 #include <errno.h>
+#include <limits.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
+#define ZEROCOPY_WAIT_MS 1000
+
+
 udp_sender_t* udp_sender_create(const char* local_ip, uint16_t local_port,
                                  const char* remote_ip, uint16_t remote_port,
                                  uint32_t max_packet_size, uint32_t max_frame_size) {
@@ -15,6 +26,7 @@ udp_sender_t* udp_sender_create(const char* local_ip, uint16_t local_port,
     sender->max_packet_size = max_packet_size;
     sender->max_payload_per_packet = max_packet_size - PACKET_HEADER_SIZE;
     sender->max_frame_size = max_frame_size;
+    sender->tx_mode = UDP_TX_COPY;
     
     sender->packet_buf = malloc(max_packet_size);
     if (!sender->packet_buf) {
@@ -33,20 +45,459 @@ udp_sender_t* udp_sender_create(const char* local_ip, uint16_t local_port,
     sender->remote_addr.sin_port = htons(remote_port);
     sender->remote_addr.sin_addr.s_addr = inet_addr(remote_ip);
     
+    pthread_mutex_init(&sender->cache_lock, NULL);
+    pthread_mutex_init(&sender->pace_lock, NULL);
+    atomic_init(&sender->feedback_running, false);
+    
     return sender;
 }
 
-int udp_sender_transmit(udp_sender_t* sender, uint64_t timestamp_us,
-                        const void* frame_data, uint32_t frame_len,
-                        uint32_t repeat_count) {
-    if (!sender || !frame_data || frame_len == 0) return -1;
-    if (frame_len > sender->max_frame_size) return -1;
+static uint32_t max_segments(const udp_sender_t* sender) {
+    return (sender->max_frame_size + sender->max_payload_per_packet - 1) / sender->max_payload_per_packet;
+}
+
+/* One header, two iovecs and one message per packet of the largest frame,
+ * plus its parity packets at the configured group size. */
+static int alloc_messages(udp_sender_t* sender) {
+    uint32_t max_packets = max_segments(sender) + udp_fec_group_count(max_segments(sender), sender->fec_k);
+    if (sender->msgs && max_packets <= sender->max_packets) return 0;
     
-    uint32_t seg_count = (frame_len + sender->max_payload_per_packet - 1) / sender->max_payload_per_packet;
+    packet_header_t* headers = calloc(max_packets, sizeof(packet_header_t));
+    struct iovec* iovs = calloc((size_t)max_packets * 2, sizeof(struct iovec));
+    struct mmsghdr* msgs = calloc(max_packets, sizeof(struct mmsghdr));
+    if (!headers || !iovs || !msgs) {
+        free(headers);
+        free(iovs);
+        free(msgs);
+        return -1;
+    }
+    
+    free(sender->headers);
+    free(sender->iovs);
+    free(sender->msgs);
+    sender->headers = headers;
+    sender->iovs = iovs;
+    sender->msgs = msgs;
+    sender->max_packets = max_packets;
+    return 0;
+}
+
+int udp_sender_set_tx_mode(udp_sender_t* sender, int tx_mode, uint32_t zerocopy_threshold) {
+    if (!sender) return -1;
+    if (tx_mode != UDP_TX_COPY && tx_mode != UDP_TX_MMSG && tx_mode != UDP_TX_GSO) return -1;
+    
+    int gso_size = tx_mode == UDP_TX_GSO ? (int)sender->max_packet_size : 0;
+    if (setsockopt(sender->local.sock_fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) < 0 &&
+        tx_mode == UDP_TX_GSO) {
+        return -1;
+    }
+    
+    sender->gso_segments = UDP_GSO_MAX_BYTES / sender->max_packet_size;
+    if (sender->gso_segments > UDP_GSO_MAX_SEGMENTS) sender->gso_segments = UDP_GSO_MAX_SEGMENTS;
+    if (sender->gso_segments == 0) sender->gso_segments = 1;
+    
+    sender->tx_mode = tx_mode;
+    if (tx_mode == UDP_TX_COPY) return 0;
+    
+    if (alloc_messages(sender) < 0) {
+        sender->tx_mode = UDP_TX_COPY;
+        return -1;
+    }
+    
+    sender->zerocopy = false;
+    sender->zerocopy_threshold = zerocopy_threshold;
+    if (zerocopy_threshold > 0) {
+        int opt_val = 1;
+        sender->zerocopy = setsockopt(sender->local.sock_fd, SOL_SOCKET, SO_ZEROCOPY,
+                                      &opt_val, sizeof(opt_val)) == 0;
+    }
+    
+    return 0;
+}
+
+int udp_sender_set_fec(udp_sender_t* sender, uint32_t fec_k) {
+    if (!sender || fec_k > UDP_FEC_MAX_K) return -1;
+    
+    free(sender->fec_parity);
+    free(sender->fec_lens);
+    sender->fec_parity = NULL;
+    sender->fec_lens = NULL;
+    sender->fec_groups = 0;
+    
+    uint32_t old_k = sender->fec_k;
+    sender->fec_k = fec_k;
+    if (sender->tx_mode != UDP_TX_COPY && alloc_messages(sender) < 0) {
+        sender->fec_k = old_k;
+        return -1;
+    }
+    return 0;
+}
+
+/* Parity buffers grow to the groups of the largest frame sent so far
+ * rather than being sized for JPEG_LEN up front. */
+static int reserve_parity(udp_sender_t* sender, uint32_t groups) {
+    if (groups <= sender->fec_groups) return 0;
+    
+    uint8_t* parity = realloc(sender->fec_parity, (size_t)groups * sender->max_payload_per_packet);
+    if (!parity) return -1;
+    sender->fec_parity = parity;
+    
+    uint32_t* lens = realloc(sender->fec_lens, groups * sizeof(uint32_t));
+    if (!lens) return -1;
+    sender->fec_lens = lens;
+    
+    sender->fec_groups = groups;
+    return 0;
+}
+
+/* Returns the number of parity packets built, or -1 if their buffers
+ * could not be grown. */
+static int build_parity(udp_sender_t* sender, const uint8_t* src, uint32_t frame_len,
+                        uint32_t seg_count) {
+    uint32_t stride = sender->max_payload_per_packet;
+    uint32_t groups = udp_fec_group_count(seg_count, sender->fec_k);
+    if (reserve_parity(sender, groups) < 0) return -1;
+    
+    for (uint32_t g = 0; g < groups; g++) {
+        uint8_t* parity = sender->fec_parity + (size_t)g * stride;
+        uint32_t parity_len = 0;
+        
+        memset(parity, 0, stride);
+        for (uint32_t seg = g; seg < seg_count; seg += groups) {
+            uint32_t offset = seg * stride;
+            uint32_t len = seg == seg_count - 1 ? frame_len - offset : stride;
+            udp_fec_xor(parity, src + offset, len);
+            if (len > parity_len) parity_len = len;
+        }
+        sender->fec_lens[g] = parity_len;
+    }
+    
+    return (int)groups;
+}
+
+/* Parity headers reuse the data layout: seg_idx carries the FEC flag, the
+ * group size and the group index, and seg_count carries the frame length
+ * so the receiver can size a rebuilt final segment. Receivers without FEC
+ * reject seg_idx >= MAX_SEGMENTS_PER_FRAME and never see them. */
+static void fill_parity_header(udp_sender_t* sender, packet_header_t* hdr, uint64_t ts_be,
+                               uint32_t frame_len, uint32_t group) {
+    hdr->frame_ts_us = ts_be;
+    hdr->seg_idx = htonl(PACKET_FEC_FLAG | (sender->fec_k << PACKET_FEC_K_SHIFT) | group);
+    hdr->seg_count = htonl(frame_len);
+    hdr->payload_len = htonl(sender->fec_lens[group]);
+}
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+int udp_sender_set_pacing(udp_sender_t* sender, uint64_t bits_per_s, uint32_t burst_bytes) {
+    if (!sender) return -1;
+    if (burst_bytes == 0) burst_bytes = UDP_SENDER_BURST_DEFAULT;
+    
+    pthread_mutex_lock(&sender->pace_lock);
+    sender->pace_bytes_per_s = bits_per_s / 8;
+    sender->pace_burst = burst_bytes;
+    sender->pace_tokens = burst_bytes;
+    sender->pace_refill_us = monotonic_us();
+    pthread_mutex_unlock(&sender->pace_lock);
+    
+    /* With the fq qdisc the kernel also spaces packets within a burst */
+    unsigned int rate = sender->pace_bytes_per_s && sender->pace_bytes_per_s < UINT_MAX
+        ? (unsigned int)sender->pace_bytes_per_s : UINT_MAX;
+    setsockopt(sender->local.sock_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+    
+    return 0;
+}
+
+/* Token bucket of pace_burst bytes refilled at pace_bytes_per_s. A send
+ * larger than the bucket (a GSO message) waits for a full bucket and
+ * leaves it in debt, so the long-run rate still holds. The bytes are
+ * charged up front and the caller sleeps outside the lock, so the sender
+ * and the retransmits of the feedback thread share one bucket. Returns
+ * how long the caller has to wait. */
+static uint64_t pace_reserve(udp_sender_t* sender, uint32_t bytes) {
+    pthread_mutex_lock(&sender->pace_lock);
+    
+    uint64_t now = monotonic_us();
+    if (now > sender->pace_refill_us) {
+        uint64_t elapsed = now - sender->pace_refill_us;
+        if (elapsed > 1000000) elapsed = 1000000;
+        sender->pace_tokens += (int64_t)(elapsed * sender->pace_bytes_per_s / 1000000);
+        if (sender->pace_tokens > sender->pace_burst) sender->pace_tokens = sender->pace_burst;
+        sender->pace_refill_us = now;
+    }
+    
+    int64_t needed = bytes < sender->pace_burst ? bytes : sender->pace_burst;
+    uint64_t wait_us = 0;
+    if (sender->pace_tokens < needed) {
+        wait_us = (uint64_t)(needed - sender->pace_tokens) * 1000000 / sender->pace_bytes_per_s;
+        sender->pace_tokens += (int64_t)(wait_us * sender->pace_bytes_per_s / 1000000);
+        sender->pace_refill_us += wait_us;
+    }
+    sender->pace_tokens -= bytes;
+    
+    pthread_mutex_unlock(&sender->pace_lock);
+    return wait_us;
+}
+
+/* Gives back bytes reserved for messages the kernel did not take. */
+static void pace_refund(udp_sender_t* sender, uint32_t bytes) {
+    if (!sender->pace_bytes_per_s || bytes == 0) return;
+    
+    pthread_mutex_lock(&sender->pace_lock);
+    sender->pace_tokens += bytes;
+    if (sender->pace_tokens > sender->pace_burst) sender->pace_tokens = sender->pace_burst;
+    pthread_mutex_unlock(&sender->pace_lock);
+}
+
+static void pace_sleep(uint64_t wait_us) {
+    struct timespec ts = { .tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+}
+
+static void pace_wait(udp_sender_t* sender, uint32_t bytes) {
+    if (!sender->pace_bytes_per_s) return;
+    
+    uint64_t wait_us = pace_reserve(sender, bytes);
+    if (wait_us == 0) return;
+    
+    pace_sleep(wait_us);
+    sender->pace_frame_delay_us += wait_us;
+}
+
+static uint32_t message_wire_bytes(const struct msghdr* msg) {
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < msg->msg_iovlen; i++) bytes += msg->msg_iov[i].iov_len;
+    return bytes + (uint32_t)(msg->msg_iovlen / 2) * UDP_IP_HEADER_BYTES;
+}
+
+static void retransmit_segments(udp_sender_t* sender, const udp_sent_frame_t* frame,
+                                uint32_t base, const uint8_t* bitmap, uint32_t bitmap_len) {
+    uint32_t stride = sender->max_payload_per_packet;
+    packet_header_t* hdr = (packet_header_t*)sender->retransmit_buf;
+    hdr->frame_ts_us = htobe64(frame->ts);
+    hdr->seg_count = htonl(frame->seg_count);
+    
+    for (uint32_t bit = 0; bit < bitmap_len * 8; bit++) {
+        if (!(bitmap[bit / 8] & (1u << (bit % 8)))) continue;
+        
+        uint32_t seg = base + bit;
+        if (seg >= frame->seg_count) break;
+        
+        uint32_t offset = seg * stride;
+        uint32_t payload_len = seg == frame->seg_count - 1 ? frame->len - offset : stride;
+        hdr->seg_idx = htonl(seg);
+        hdr->payload_len = htonl(payload_len);
+        memcpy(sender->retransmit_buf + PACKET_HEADER_SIZE, frame->data + offset, payload_len);
+        
+        if (sender->pace_bytes_per_s) {
+            pace_sleep(pace_reserve(sender, PACKET_HEADER_SIZE + payload_len + UDP_IP_HEADER_BYTES));
+        }
+        if (sendto(sender->local.sock_fd, sender->retransmit_buf, PACKET_HEADER_SIZE + payload_len, 0,
+                   (struct sockaddr*)&sender->remote_addr, sizeof(sender->remote_addr)) >= 0) {
+            atomic_fetch_add_explicit(&sender->stats.retransmits, 1, memory_order_relaxed);
+        }
+    }
+}
+
+/* The receiver's send time is echoed in frame_ts_us, followed by this
+ * side's receive and send times, so it can estimate the clock offset. */
+static void reply_pong(udp_sender_t* sender, const packet_header_t* ping,
+                       const struct sockaddr_in* from, uint64_t received_us) {
+    uint8_t packet[PACKET_HEADER_SIZE + PACKET_PONG_BYTES];
+    packet_header_t* hdr = (packet_header_t*)packet;
+    hdr->frame_ts_us = ping->frame_ts_us;
+    hdr->seg_idx = htonl(PACKET_CONTROL_FLAG | PACKET_CONTROL_PONG);
+    hdr->seg_count = 0;
+    hdr->payload_len = htonl(PACKET_PONG_BYTES);
+    
+    uint64_t times[2] = { htobe64(received_us), htobe64(udp_get_time_us()) };
+    memcpy(packet + PACKET_HEADER_SIZE, times, sizeof(times));
+    
+    if (sendto(sender->local.sock_fd, packet, sizeof(packet), 0,
+               (const struct sockaddr*)from, sizeof(*from)) >= 0) {
+        atomic_fetch_add_explicit(&sender->stats.pongs, 1, memory_order_relaxed);
+    }
+}
+
+/* NACKs reuse the packet header: seg_idx carries PACKET_CONTROL_FLAG and the
+ * type, seg_count the first segment covered and the payload a bitmap with
+ * bit i (LSB first) set for each missing segment base + i. */
+static void handle_feedback(udp_sender_t* sender, const uint8_t* buf, ssize_t len,
+                            const struct sockaddr_in* from, uint64_t received_us) {
+    if (len < (ssize_t)PACKET_HEADER_SIZE) return;
+    
+    const packet_header_t* hdr = (const packet_header_t*)buf;
+    uint32_t type = ntohl(hdr->seg_idx);
+    uint32_t payload_len = ntohl(hdr->payload_len);
+    
+    if (type == (PACKET_CONTROL_FLAG | PACKET_CONTROL_PING)) {
+        if (sender->clock_enabled && len == (ssize_t)PACKET_HEADER_SIZE) reply_pong(sender, hdr, from, received_us);
+        return;
+    }
+    
+    if (type != (PACKET_CONTROL_FLAG | PACKET_CONTROL_NACK) || sender->nack_deadline_us == 0) return;
+    if (payload_len > PACKET_NACK_MAX_BYTES || (ssize_t)(PACKET_HEADER_SIZE + payload_len) != len) return;
+    
+    uint64_t ts = be64toh(hdr->frame_ts_us);
+    uint64_t now = monotonic_us();
+    atomic_fetch_add_explicit(&sender->stats.nacks, 1, memory_order_relaxed);
+    
+    pthread_mutex_lock(&sender->cache_lock);
+    for (uint32_t i = 0; i < UDP_SENDER_CACHE_FRAMES; i++) {
+        const udp_sent_frame_t* frame = &sender->cache[i];
+        if (frame->len == 0 || frame->ts != ts) continue;
+        
+        if (now - frame->sent_us > sender->nack_deadline_us) {
+            atomic_fetch_add_explicit(&sender->stats.nacks_expired, 1, memory_order_relaxed);
+        } else {
+            retransmit_segments(sender, frame, ntohl(hdr->seg_count), buf + PACKET_HEADER_SIZE, payload_len);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&sender->cache_lock);
+}
+
+static void* feedback_thread(void* arg) {
+    udp_sender_t* sender = arg;
+    uint8_t buf[PACKET_HEADER_SIZE + PACKET_NACK_MAX_BYTES];
+    
+    while (atomic_load(&sender->feedback_running)) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(sender->local.sock_fd, buf, sizeof(buf), 0,
+                               (struct sockaddr*)&from, &from_len);
+        if (len > 0) handle_feedback(sender, buf, len, &from, udp_get_time_us());
+    }
+    
+    return NULL;
+}
+
+static void free_cache(udp_sender_t* sender) {
+    for (uint32_t i = 0; i < UDP_SENDER_CACHE_FRAMES; i++) {
+        free(sender->cache[i].data);
+        sender->cache[i].data = NULL;
+        sender->cache[i].len = 0;
+    }
+    free(sender->retransmit_buf);
+    sender->retransmit_buf = NULL;
+}
+
+static int alloc_cache(udp_sender_t* sender) {
+    sender->retransmit_buf = malloc(sender->max_packet_size);
+    if (!sender->retransmit_buf) return -1;
+    
+    for (uint32_t i = 0; i < UDP_SENDER_CACHE_FRAMES; i++) {
+        sender->cache[i].data = malloc(sender->max_frame_size);
+        if (!sender->cache[i].data) {
+            free_cache(sender);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* The feedback thread only runs while clock pings or NACKs are answered;
+ * a sender without either never reads its socket. */
+static int start_feedback(udp_sender_t* sender) {
+    if (!sender->clock_enabled && sender->nack_deadline_us == 0) return 0;
+    
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = UDP_SENDER_FEEDBACK_POLL_MS * 1000 };
+    if (setsockopt(sender->local.sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) return -1;
+    
+    atomic_store(&sender->feedback_running, true);
+    if (pthread_create(&sender->feedback_thread, NULL, feedback_thread, sender) != 0) {
+        atomic_store(&sender->feedback_running, false);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_feedback(udp_sender_t* sender) {
+    if (!atomic_load(&sender->feedback_running)) return;
+    
+    atomic_store(&sender->feedback_running, false);
+    pthread_join(sender->feedback_thread, NULL);
+}
+
+int udp_sender_set_nack(udp_sender_t* sender, uint32_t deadline_ms) {
+    if (!sender) return -1;
+    
+    stop_feedback(sender);
+    free_cache(sender);
+    sender->nack_deadline_us = 0;
+    
+    int result = deadline_ms > 0 ? alloc_cache(sender) : 0;
+    if (result == 0) sender->nack_deadline_us = deadline_ms * 1000ULL;
+    
+    if (start_feedback(sender) < 0) {
+        free_cache(sender);
+        sender->nack_deadline_us = 0;
+        return -1;
+    }
+    return result;
+}
+
+int udp_sender_set_clock_sync(udp_sender_t* sender, bool enabled) {
+    if (!sender) return -1;
+    
+    stop_feedback(sender);
+    sender->clock_enabled = enabled;
+    
+    if (start_feedback(sender) < 0) {
+        sender->clock_enabled = false;
+        return -1;
+    }
+    return 0;
+}
+
+/* The caller's buffer is only valid during udp_sender_transmit(), so NACK
+ * costs one copy of every frame sent. */
+static void cache_frame(udp_sender_t* sender, uint64_t timestamp_us, const uint8_t* src,
+                        uint32_t frame_len, uint32_t seg_count) {
+    pthread_mutex_lock(&sender->cache_lock);
+    
+    udp_sent_frame_t* frame = &sender->cache[sender->cache_next];
+    sender->cache_next = (sender->cache_next + 1) % UDP_SENDER_CACHE_FRAMES;
+    
+    memcpy(frame->data, src, frame_len);
+    frame->ts = timestamp_us;
+    frame->len = frame_len;
+    frame->seg_count = seg_count;
+    frame->sent_us = monotonic_us();
+    
+    pthread_mutex_unlock(&sender->cache_lock);
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int send_datagram(udp_sender_t* sender, ssize_t total_len) {
+    ssize_t sent;
+    
+    do {
+        sent = sendto(sender->local.sock_fd, sender->packet_buf, total_len, 0,
+                      (struct sockaddr*)&sender->remote_addr, sizeof(sender->remote_addr));
+        sender->stats.syscalls++;
+    } while (sent < 0 && errno == EINTR);
+    
+    return sent < 0 ? -1 : 0;
+}
+
+static int transmit_copy(udp_sender_t* sender, uint64_t timestamp_us,
+                         const uint8_t* src, uint32_t frame_len, uint32_t seg_count,
+                         uint32_t repeat_count) {
     uint64_t ts_be = htobe64(timestamp_us);
     uint32_t count_be = htonl(seg_count);
-    
-    const uint8_t* src = (const uint8_t*)frame_data;
+    int parity = sender->fec_k ? build_parity(sender, src, frame_len, seg_count) : 0;
+    if (parity < 0) return -1;
+    uint32_t groups = parity;
     
     for (uint32_t round = 0; round < repeat_count; round++) {
         for (uint32_t seg = 0; seg < seg_count; seg++) {
@@ -63,24 +514,269 @@ int udp_sender_transmit(udp_sender_t* sender, uint64_t timestamp_us,
             
             memcpy(sender->packet_buf + PACKET_HEADER_SIZE, src + offset, payload_len);
             
-            ssize_t total_len = PACKET_HEADER_SIZE + payload_len;
-            ssize_t sent;
+            pace_wait(sender, PACKET_HEADER_SIZE + payload_len + UDP_IP_HEADER_BYTES);
+            if (send_datagram(sender, PACKET_HEADER_SIZE + payload_len) < 0) return -1;
+        }
+        
+        for (uint32_t g = 0; g < groups; g++) {
+            packet_header_t* hdr = (packet_header_t*)sender->packet_buf;
+            fill_parity_header(sender, hdr, ts_be, frame_len, g);
             
-            do {
-                sent = sendto(sender->local.sock_fd, sender->packet_buf, total_len, 0,
-                              (struct sockaddr*)&sender->remote_addr, sizeof(sender->remote_addr));
-            } while (sent < 0 && errno == EINTR);
+            memcpy(sender->packet_buf + PACKET_HEADER_SIZE,
+                   sender->fec_parity + (size_t)g * sender->max_payload_per_packet, sender->fec_lens[g]);
             
-            if (sent < 0) return -1;
+            pace_wait(sender, PACKET_HEADER_SIZE + sender->fec_lens[g] + UDP_IP_HEADER_BYTES);
+            if (send_datagram(sender, PACKET_HEADER_SIZE + sender->fec_lens[g]) < 0) return -1;
+            sender->stats.fec_packets++;
         }
     }
     
     return 0;
 }
 
+static void drain_zerocopy_completions(udp_sender_t* sender) {
+    while (1) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        
+        ssize_t ret = recvmsg(sender->local.sock_fd, &msg, MSG_ERRQUEUE);
+        sender->stats.syscalls++;
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) continue;
+            
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+            
+            /* One notification covers the sends numbered ee_info to ee_data */
+            uint32_t sends = err.ee_data - err.ee_info + 1;
+            sender->zerocopy_completed += sends;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                sender->stats.zerocopy_copied += sends;
+            }
+        }
+    }
+}
+
+/* The kernel keeps referencing the caller's pages until every zerocopy
+ * send has completed, so the frame can only be handed back afterwards. */
+static int wait_zerocopy_completions(udp_sender_t* sender) {
+    drain_zerocopy_completions(sender);
+    
+    while (sender->zerocopy_completed != sender->zerocopy_issued) {
+        struct pollfd pfd = { .fd = sender->local.sock_fd, .events = 0 };
+        int ready = poll(&pfd, 1, ZEROCOPY_WAIT_MS);
+        sender->stats.syscalls++;
+        
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return -1;
+        
+        drain_zerocopy_completions(sender);
+    }
+    
+    return 0;
+}
+
+static int send_messages(udp_sender_t* sender, struct mmsghdr* msgs, uint32_t count, int flags) {
+    uint32_t done = 0;
+    
+    /* The pace charge is reserved before the batch and whatever the kernel
+     * does not take is refunded, so retries and partial sends are charged
+     * once, for the messages actually sent. */
+    while (done < count) {
+        uint32_t batch = count - done;
+        if (batch > UIO_MAXIOV) batch = UIO_MAXIOV;
+        
+        uint32_t reserved = 0;
+        if (sender->pace_bytes_per_s) {
+            reserved = message_wire_bytes(&msgs[done].msg_hdr);
+            uint32_t n = 1;
+            while (n < batch) {
+                uint32_t next = message_wire_bytes(&msgs[done + n].msg_hdr);
+                if (reserved + next > sender->pace_burst) break;
+                reserved += next;
+                n++;
+            }
+            batch = n;
+            pace_wait(sender, reserved);
+        }
+        
+        int sent = sendmmsg(sender->local.sock_fd, msgs + done, batch, flags);
+        sender->stats.syscalls++;
+        
+        if (sent < 0) {
+            pace_refund(sender, reserved);
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+            /* Zerocopy GSO messages are capped at MAX_SKB_FRAGS pages */
+            if (errno == EMSGSIZE && (flags & MSG_ZEROCOPY)) {
+                sender->zerocopy = false;
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+            return -1;
+        }
+        
+        if (reserved && (uint32_t)sent < batch) {
+            uint32_t unsent = 0;
+            for (uint32_t i = sent; i < batch; i++) unsent += message_wire_bytes(&msgs[done + i].msg_hdr);
+            pace_refund(sender, unsent);
+        }
+        
+        if (flags & MSG_ZEROCOPY) {
+            sender->zerocopy_issued += sent;
+            sender->stats.zerocopy_sends += sent;
+        }
+        done += sent;
+    }
+    
+    return 0;
+}
+
+static uint32_t build_messages(udp_sender_t* sender, uint32_t msg_idx, uint32_t first_packet,
+                               uint32_t packet_count, uint32_t per_msg) {
+    for (uint32_t done = 0; done < packet_count; done += per_msg, msg_idx++) {
+        uint32_t first = first_packet + done;
+        uint32_t packets = packet_count - done < per_msg ? packet_count - done : per_msg;
+        
+        struct msghdr* msg = &sender->msgs[msg_idx].msg_hdr;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = &sender->remote_addr;
+        msg->msg_namelen = sizeof(sender->remote_addr);
+        msg->msg_iov = &sender->iovs[first * 2];
+        msg->msg_iovlen = packets * 2;
+    }
+    
+    return msg_idx;
+}
+
+static int transmit_mmsg(udp_sender_t* sender, uint64_t timestamp_us,
+                         const uint8_t* src, uint32_t frame_len, uint32_t seg_count,
+                         uint32_t repeat_count) {
+    uint64_t ts_be = htobe64(timestamp_us);
+    uint32_t count_be = htonl(seg_count);
+    
+    for (uint32_t seg = 0; seg < seg_count; seg++) {
+        uint32_t offset = seg * sender->max_payload_per_packet;
+        uint32_t payload_len = (seg == seg_count - 1)
+            ? (frame_len - offset)
+            : sender->max_payload_per_packet;
+        
+        packet_header_t* hdr = &sender->headers[seg];
+        hdr->frame_ts_us = ts_be;
+        hdr->seg_idx = htonl(seg);
+        hdr->seg_count = count_be;
+        hdr->payload_len = htonl(payload_len);
+        
+        struct iovec* iov = &sender->iovs[seg * 2];
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = PACKET_HEADER_SIZE;
+        iov[1].iov_base = (void*)(src + offset);
+        iov[1].iov_len = payload_len;
+        
+    }
+    
+    int parity = sender->fec_k ? build_parity(sender, src, frame_len, seg_count) : 0;
+    if (parity < 0) return -1;
+    uint32_t groups = parity;
+    
+    for (uint32_t g = 0; g < groups; g++) {
+        packet_header_t* hdr = &sender->headers[seg_count + g];
+        fill_parity_header(sender, hdr, ts_be, frame_len, g);
+        
+        struct iovec* iov = &sender->iovs[(seg_count + g) * 2];
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = PACKET_HEADER_SIZE;
+        iov[1].iov_base = sender->fec_parity + (size_t)g * sender->max_payload_per_packet;
+        iov[1].iov_len = sender->fec_lens[g];
+    }
+    
+    /* With GSO every message carries a run of full-size datagrams that the
+     * kernel splits at max_packet_size; only the final data segment and the
+     * final parity packet may be short, and each ends its run. */
+    uint32_t per_msg = sender->tx_mode == UDP_TX_GSO ? sender->gso_segments : 1;
+    uint32_t msg_count = build_messages(sender, 0, 0, seg_count, per_msg);
+    msg_count = build_messages(sender, msg_count, seg_count, groups, per_msg);
+    
+    int flags = 0;
+    if (sender->zerocopy && frame_len >= sender->zerocopy_threshold) {
+        flags |= MSG_ZEROCOPY;
+        sender->stats.zerocopy_frames++;
+    }
+    
+    int result = 0;
+    for (uint32_t round = 0; round < repeat_count && result == 0; round++) {
+        result = send_messages(sender, sender->msgs, msg_count, flags);
+        if (result == 0) sender->stats.fec_packets += groups;
+    }
+    
+    if (sender->zerocopy_issued != sender->zerocopy_completed) {
+        if (wait_zerocopy_completions(sender) < 0) result = -1;
+    }
+    
+    return result;
+}
+
+int udp_sender_transmit(udp_sender_t* sender, uint64_t timestamp_us,
+                        const void* frame_data, uint32_t frame_len,
+                        uint32_t repeat_count) {
+    if (!sender || !frame_data || frame_len == 0) return -1;
+    if (frame_len > sender->max_frame_size) return -1;
+    
+    uint64_t cpu_start = thread_cpu_ns();
+    uint32_t seg_count = (frame_len + sender->max_payload_per_packet - 1) / sender->max_payload_per_packet;
+    const uint8_t* src = (const uint8_t*)frame_data;
+    
+    if (sender->nack_deadline_us) cache_frame(sender, timestamp_us, src, frame_len, seg_count);
+    sender->pace_frame_delay_us = 0;
+    
+    int result;
+    if (sender->tx_mode == UDP_TX_GSO) {
+        result = transmit_mmsg(sender, timestamp_us, src, frame_len, seg_count, repeat_count);
+        if (result < 0 && errno == EIO) {
+            /* The egress device cannot checksum-offload GSO datagrams. */
+            udp_sender_set_tx_mode(sender, UDP_TX_MMSG, sender->zerocopy_threshold);
+            result = transmit_mmsg(sender, timestamp_us, src, frame_len, seg_count, repeat_count);
+        }
+    } else if (sender->tx_mode == UDP_TX_MMSG) {
+        result = transmit_mmsg(sender, timestamp_us, src, frame_len, seg_count, repeat_count);
+    } else {
+        result = transmit_copy(sender, timestamp_us, src, frame_len, seg_count, repeat_count);
+    }
+    
+    sender->stats.frames++;
+    sender->stats.cpu_ns += thread_cpu_ns() - cpu_start;
+    sender->stats.pace_delay_us += sender->pace_frame_delay_us;
+    if (sender->pace_frame_delay_us > sender->stats.pace_delay_max_us) {
+        sender->stats.pace_delay_max_us = sender->pace_frame_delay_us;
+    }
+    
+    return result;
+}
+
 void udp_sender_destroy(udp_sender_t* sender) {
     if (!sender) return;
+    stop_feedback(sender);
     udp_close_socket(&sender->local);
+    free_cache(sender);
+    pthread_mutex_destroy(&sender->cache_lock);
+    pthread_mutex_destroy(&sender->pace_lock);
+    free(sender->msgs);
+    free(sender->iovs);
+    free(sender->headers);
+    free(sender->fec_lens);
+    free(sender->fec_parity);
     free(sender->packet_buf);
     free(sender);
 }
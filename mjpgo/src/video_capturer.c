@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <linux/videodev2.h>
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,9 +33,55 @@ static uint64_t compute_epoch_offset(void) {
     return wall_us - mono_us;
 }
 
+static void unmap_buffers(video_capturer_t* cap) {
+    for (uint32_t i = 0; i < cap->buffer_count; i++) {
+        capture_buffer_t* b = &cap->buffers[i];
+        if (b->data && b->data != MAP_FAILED) munmap(b->data, b->length);
+    }
+    free(cap->buffers);
+    cap->buffers = NULL;
+    cap->buffer_count = 0;
+}
+
+static int map_buffers(video_capturer_t* cap, uint32_t buffer_count) {
+    struct v4l2_requestbuffers reqbuf;
+    memset(&reqbuf, 0, sizeof(reqbuf));
+    reqbuf.count = buffer_count;
+    reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqbuf.memory = V4L2_MEMORY_MMAP;
+    if (safe_ioctl(cap->device_fd, VIDIOC_REQBUFS, &reqbuf) < 0) return -1;
+    if (reqbuf.count < CAPTURER_BUFFER_COUNT_MIN) return -1;
+    
+    cap->buffers = calloc(reqbuf.count, sizeof(capture_buffer_t));
+    if (!cap->buffers) return -1;
+    
+    for (uint32_t i = 0; i < reqbuf.count; i++) {
+        capture_buffer_t* b = &cap->buffers[i];
+        b->index = i;
+        cap->buffer_count++;
+        
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (safe_ioctl(cap->device_fd, VIDIOC_QUERYBUF, &buf) < 0) return -1;
+        
+        b->length = buf.length;
+        b->data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, cap->device_fd, buf.m.offset);
+        if (b->data == MAP_FAILED) return -1;
+    }
+    
+    return 0;
+}
+
 video_capturer_t* video_capturer_create(const char* device_path,
                                          uint32_t width, uint32_t height,
-                                         uint32_t fps_num, uint32_t fps_den) {
+                                         uint32_t fps_num, uint32_t fps_den,
+                                         uint32_t buffer_count) {
+    if (buffer_count < CAPTURER_BUFFER_COUNT_MIN || buffer_count > CAPTURER_BUFFER_COUNT_MAX) return NULL;
+    
     struct stat st;
     if (stat(device_path, &st) < 0) return NULL;
     if (!S_ISCHR(st.st_mode)) return NULL;
@@ -52,6 +99,7 @@ video_capturer_t* video_capturer_create(const char* device_path,
     cap->height = height;
     cap->epoch_offset_us = compute_epoch_offset();
     cap->active_index = -1;
+    atomic_init(&cap->queued_count, 0);
     
     struct v4l2_capability caps;
     memset(&caps, 0, sizeof(caps));
@@ -75,35 +123,10 @@ video_capturer_t* video_capturer_create(const char* device_path,
     parm.parm.capture.timeperframe.denominator = fps_den;
     if (safe_ioctl(cap->device_fd, VIDIOC_S_PARM, &parm) < 0) goto fail;
     
-    struct v4l2_requestbuffers reqbuf;
-    memset(&reqbuf, 0, sizeof(reqbuf));
-    reqbuf.count = CAPTURER_BUFFER_COUNT;
-    reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    reqbuf.memory = V4L2_MEMORY_MMAP;
-    if (safe_ioctl(cap->device_fd, VIDIOC_REQBUFS, &reqbuf) < 0) goto fail;
-    if (reqbuf.count != CAPTURER_BUFFER_COUNT) goto fail;
-    
-    for (int i = 0; i < CAPTURER_BUFFER_COUNT; i++) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        if (safe_ioctl(cap->device_fd, VIDIOC_QUERYBUF, &buf) < 0) goto fail;
-        
-        cap->buffers[i].length = buf.length;
-        cap->buffers[i].data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
-                                     MAP_SHARED, cap->device_fd, buf.m.offset);
-        if (cap->buffers[i].data == MAP_FAILED) goto fail;
-    }
+    if (map_buffers(cap, buffer_count) < 0) goto fail;
     
-    for (int i = 0; i < CAPTURER_BUFFER_COUNT; i++) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        if (safe_ioctl(cap->device_fd, VIDIOC_QBUF, &buf) < 0) goto fail;
+    for (uint32_t i = 0; i < cap->buffer_count; i++) {
+        if (video_capturer_requeue(cap, &cap->buffers[i]) < 0) goto fail;
     }
     
     enum v4l2_buf_type stream_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -112,46 +135,105 @@ video_capturer_t* video_capturer_create(const char* device_path,
     return cap;
 
 fail:
-    for (int i = 0; i < CAPTURER_BUFFER_COUNT; i++) {
-        if (cap->buffers[i].data && cap->buffers[i].data != MAP_FAILED) {
-            munmap(cap->buffers[i].data, cap->buffers[i].length);
-        }
-    }
+    unmap_buffers(cap);
     close(cap->device_fd);
     free(cap);
     return NULL;
 }
 
-int video_capturer_grab_frame(video_capturer_t* cap) {
-    if (!cap || cap->device_fd < 0) return -1;
+/* In non-blocking mode video_capturer_dequeue() returns 0 when no frame is
+ * ready, so one thread can poll several devices. */
+int video_capturer_set_nonblocking(video_capturer_t* cap, bool nonblocking) {
+    if (!cap) return -1;
     
+    int flags = fcntl(cap->device_fd, F_GETFL);
+    if (flags < 0) return -1;
+    flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(cap->device_fd, F_SETFL, flags);
+}
+
+void video_capturer_set_latest_only(video_capturer_t* cap, bool latest_only) {
+    if (cap) cap->latest_only = latest_only;
+}
+
+static int dequeue_one(video_capturer_t* cap, capture_buffer_t** out) {
     struct v4l2_buffer buf;
     memset(&buf, 0, sizeof(buf));
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
     
-    if (safe_ioctl(cap->device_fd, VIDIOC_DQBUF, &buf) < 0) return -1;
+    if (safe_ioctl(cap->device_fd, VIDIOC_DQBUF, &buf) < 0) return errno == EAGAIN ? 0 : -1;
+    if (buf.index >= cap->buffer_count) return -1;
+    atomic_fetch_sub_explicit(&cap->queued_count, 1, memory_order_relaxed);
     
-    cap->active_index = buf.index;
-    cap->buffers[buf.index].used = buf.bytesused;
-    cap->buffers[buf.index].timestamp_us = 
-        (uint64_t)buf.timestamp.tv_sec * 1000000ULL + 
-        (uint64_t)buf.timestamp.tv_usec + 
+    capture_buffer_t* b = &cap->buffers[buf.index];
+    b->used = buf.bytesused;
+    b->timestamp_us =
+        (uint64_t)buf.timestamp.tv_sec * 1000000ULL +
+        (uint64_t)buf.timestamp.tv_usec +
         cap->epoch_offset_us;
     
-    return 0;
+    *out = b;
+    return 1;
 }
 
-void video_capturer_release_frame(video_capturer_t* cap) {
-    if (!cap || cap->active_index < 0) return;
+/* Returns 1 with a frame, 0 when none is ready yet and -1 once the device
+ * has failed. Any number of buffers may be dequeued at once and requeued in
+ * any order, from any thread; the driver only stalls once none are left
+ * queued. With latest_only set, every other frame already waiting is
+ * requeued unseen so a stall never turns into lasting queueing delay. */
+int video_capturer_dequeue(video_capturer_t* cap, capture_buffer_t** out) {
+    if (!cap || !out || cap->device_fd < 0) return -1;
+    
+    capture_buffer_t* newest;
+    int ret = dequeue_one(cap, &newest);
+    if (ret <= 0) return ret;
+    
+    struct pollfd pfd = { .fd = cap->device_fd, .events = POLLIN };
+    while (cap->latest_only && poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+        capture_buffer_t* next;
+        if (dequeue_one(cap, &next) <= 0) break;
+        
+        video_capturer_requeue(cap, newest);
+        cap->stale_frames++;
+        newest = next;
+    }
+    
+    *out = newest;
+    return 1;
+}
+
+int video_capturer_requeue(video_capturer_t* cap, capture_buffer_t* b) {
+    if (!cap || !b) return -1;
     
     struct v4l2_buffer buf;
     memset(&buf, 0, sizeof(buf));
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
-    buf.index = cap->active_index;
+    buf.index = b->index;
+    
+    if (safe_ioctl(cap->device_fd, VIDIOC_QBUF, &buf) < 0) return -1;
+    atomic_fetch_add_explicit(&cap->queued_count, 1, memory_order_relaxed);
+    return 0;
+}
+
+uint32_t video_capturer_queued(video_capturer_t* cap) {
+    if (!cap) return 0;
+    return atomic_load_explicit(&cap->queued_count, memory_order_relaxed);
+}
+
+int video_capturer_grab_frame(video_capturer_t* cap) {
+    capture_buffer_t* b;
+    if (video_capturer_dequeue(cap, &b) <= 0) return -1;
     
-    safe_ioctl(cap->device_fd, VIDIOC_QBUF, &buf);
+    cap->active_index = b->index;
+    return 0;
+}
+
+void video_capturer_release_frame(video_capturer_t* cap) {
+    if (!cap || cap->active_index < 0) return;
+    
+    video_capturer_requeue(cap, &cap->buffers[cap->active_index]);
     cap->active_index = -1;
 }
 
@@ -161,12 +243,7 @@ void video_capturer_destroy(video_capturer_t* cap) {
     enum v4l2_buf_type stream_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     safe_ioctl(cap->device_fd, VIDIOC_STREAMOFF, &stream_type);
     
-    for (int i = 0; i < CAPTURER_BUFFER_COUNT; i++) {
-        if (cap->buffers[i].data && cap->buffers[i].data != MAP_FAILED) {
-            munmap(cap->buffers[i].data, cap->buffers[i].length);
-        }
-    }
-    
+    unmap_buffers(cap);
     close(cap->device_fd);
     free(cap);
 }